@@ -10,7 +10,8 @@
 GLuint program;
 GLint attribute_coord3d, attribute_v_color;
 GLuint vbo_cube_vertices, ibo_cube_elements;
-GLint uniform_perspective, uniform_lookat, uniform_mvp;
+GLint uniform_mvp;
+mat4 view_projection;
 
 bool init_resources();
 void render(SDL_Window*);
@@ -150,20 +151,6 @@ bool init_resources() {
 		return false;
 	}
 
-	uniform_name = "lookat";
-	uniform_lookat = glGetUniformLocation(program, uniform_name);
-	if(uniform_lookat == -1) {
-		fprintf(stderr, "Could not bind uniform %s\n", uniform_name);
-		return false;
-	}
-
-	uniform_name = "perspective";
-	uniform_perspective = glGetUniformLocation(program, uniform_name);
-	if (uniform_perspective == -1) {
-		fprintf(stderr, "Could not bind uniform: %s\n", uniform_name);
-		return false;
-	}
-
 	glUseProgram(program);
 	glClearColor(1.0, 1.0, 1.0, 1.0);
 	
@@ -175,8 +162,9 @@ bool init_resources() {
 	mat4_perspective(45.0f, 1.0f*WIDTH/HEIGHT, 0.1f, 10.0f, projection);
 	mat4_look_at(eye, target, axis, view);
 
-	glUniformMatrix4fv(uniform_perspective, 1, GL_FALSE, projection);
-	glUniformMatrix4fv(uniform_lookat, 1, GL_FALSE, view);
+	// The camera is fixed, so view-projection is combined once here and
+	// logic() only adds the model matrix each frame
+	mat4_multiply(projection, view, view_projection);
 
 	return true;
 
@@ -192,8 +180,7 @@ void logic() {
 	mat4_translate(t, pos);
 	mat4_rotate_y(angle, rot);
 
-	mat4_identity(mvp);
-	mat4_multiply(mvp, pos, mvp);
+	mat4_multiply(view_projection, pos, mvp);
 	mat4_multiply(mvp, rot, mvp);
 
 	glUniformMatrix4fv(uniform_mvp, 1, GL_FALSE, mvp);
@@ -0,0 +1,1671 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <png.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <GL/glew.h>
+#include "SDL.h"
+#include "lib/dashgl.h"
+
+#define COUNT 1024
+#define TOLERANCE 1e-5f
+#define WARMUP 5
+#define SAMPLES 100
+#define MAX_RESULTS 64
+#define TEXTURE "tex/RTS_Crate.png"
+#define IMAGE 512
+#define ATLAS "bench_atlas.png"
+#define ATLAS_SIZE 4096
+#define COOKED "bench_cooked.dtex"
+
+// One timed pass runs ops operations, under the given cpu feature mask
+// and trig accuracy. Each sample times one pass.
+typedef struct {
+	const char *name;
+	void (*pass)();
+	int ops;
+	int features;
+	int accuracy;
+} benchmark;
+
+typedef struct {
+	char name[64];
+	double mean, p50, p90, p99, min;
+} result;
+
+mat4 lhs[COUNT], rhs[COUNT], out[COUNT], ref[COUNT];
+float pos[3][COUNT], angle[3][COUNT], scale[3][COUNT];
+float sin_out[COUNT], cos_out[COUNT];
+quat qa[COUNT], qb[COUNT], qout[COUNT], qref[COUNT];
+dquat da[COUNT], db[COUNT], dout[COUNT], dref[COUNT];
+float blend[COUNT];
+float bounds[4][COUNT];
+int visible[COUNT], visible_ref[COUNT];
+camera cam;
+transform_tree tree;
+int leaves[COUNT], leaf_count;
+float values[COUNT * 4], decoded[COUNT * 4];
+unsigned short halves[COUNT * 4], halves_ref[COUNT * 4];
+unsigned int packed[COUNT], packed_ref[COUNT];
+unsigned char image[IMAGE * IMAGE * 4], image_half[IMAGE * IMAGE], image_ref[IMAGE * IMAGE];
+volatile float sink;
+bool have_gl;
+result results[MAX_RESULTS];
+int result_count;
+
+double now();
+void fill_random(mat4 m);
+bool compare_floats(const char *name, float *a, float *b, int count);
+bool compare(const char *name, mat4 *a, mat4 *b, int count);
+void compose_chain(int i, mat4 m);
+void compose_fused(int i, mat4 m);
+bool check_multiply();
+bool check_compose();
+bool check_sincos();
+bool check_quat();
+bool check_inverse();
+bool check_cull();
+bool check_formats();
+bool check_downsample();
+bool check_image_transform();
+void world_brute(int i, mat4 m);
+bool check_transform();
+bool init_gl();
+void prepare();
+void run(benchmark *b);
+int compare_doubles(const void *a, const void *b);
+void print_result(result *r);
+bool save_results(const char *filename);
+int compare_results(const char *filename, double threshold);
+void pass_multiply_scalar();
+void pass_multiply();
+void pass_multiply_batch();
+void pass_rotate();
+void pass_look_at();
+void pass_perspective();
+void pass_normalize();
+void pass_compose_chain();
+void pass_compose();
+void pass_compose_batch();
+void pass_sincos_libm();
+void pass_sincos();
+void pass_sincos_batch();
+void pass_slerp();
+void pass_slerp_batch();
+void pass_inverse();
+void pass_inverse_affine();
+void pass_inverse_rigid();
+void pass_normal();
+void pass_cull_spheres();
+void pass_cull_aabbs();
+void pass_half();
+void pass_half_batch();
+void pass_transform_all();
+void pass_transform_sparse();
+void pass_downsample();
+void pass_image_transform();
+void pass_texture_load();
+void pass_texture_load_flat();
+void pass_texture_load_cpu();
+void pass_texture_acquire();
+bool needs_gl(benchmark *b);
+bool write_png(const char *filename, int size, int color_type, int bit_depth, bool trns);
+void measure_atlas();
+void report_formats();
+void evict(const char *filename);
+double time_load(GLuint (*load)(const char*), const char *filename, bool cold);
+void measure_cooked();
+
+benchmark suite[] = {
+	{ "mat4_multiply_scalar",         pass_multiply_scalar,  COUNT,      -1, DASH_TRIG_EXACT },
+	{ "mat4_multiply",                pass_multiply,         COUNT,      -1, DASH_TRIG_EXACT },
+	{ "mat4_multiply_batch",          pass_multiply_batch,   COUNT,      -1, DASH_TRIG_EXACT },
+	{ "mat4_rotate",                  pass_rotate,           COUNT,      -1, DASH_TRIG_EXACT },
+	{ "mat4_look_at",                 pass_look_at,          COUNT,      -1, DASH_TRIG_EXACT },
+	{ "mat4_perspective",             pass_perspective,      COUNT,      -1, DASH_TRIG_EXACT },
+	{ "vec3_normalize",               pass_normalize,        COUNT,      -1, DASH_TRIG_EXACT },
+	{ "translate+rotate chain",       pass_compose_chain,    COUNT,      -1, DASH_TRIG_EXACT },
+	{ "mat4_compose",                 pass_compose,          COUNT,      -1, DASH_TRIG_EXACT },
+	{ "mat4_compose_batch",           pass_compose_batch,    COUNT,      -1, DASH_TRIG_EXACT },
+	{ "mat4_compose fast",            pass_compose,          COUNT,      -1, DASH_TRIG_FAST },
+	{ "mat4_compose_batch fast",      pass_compose_batch,    COUNT,      -1, DASH_TRIG_FAST },
+	{ "sin+cos (double)",             pass_sincos_libm,      COUNT,      -1, DASH_TRIG_EXACT },
+	{ "dash_sincosf",                 pass_sincos,           COUNT,      -1, DASH_TRIG_EXACT },
+	{ "dash_sincosf fast",            pass_sincos,           COUNT,      -1, DASH_TRIG_FAST },
+	{ "dash_sincosf_batch",           pass_sincos_batch,     COUNT,      -1, DASH_TRIG_EXACT },
+	{ "dash_sincosf_batch fast",      pass_sincos_batch,     COUNT,      -1, DASH_TRIG_FAST },
+	{ "quat_slerp",                   pass_slerp,            COUNT,      -1, DASH_TRIG_EXACT },
+	{ "quat_slerp_batch",             pass_slerp_batch,      COUNT,      -1, DASH_TRIG_EXACT },
+	{ "mat4_inverse scalar",          pass_inverse,          COUNT,       0, DASH_TRIG_EXACT },
+	{ "mat4_inverse",                 pass_inverse,          COUNT,      -1, DASH_TRIG_EXACT },
+	{ "mat4_inverse_affine scalar",   pass_inverse_affine,   COUNT,       0, DASH_TRIG_EXACT },
+	{ "mat4_inverse_affine",          pass_inverse_affine,   COUNT,      -1, DASH_TRIG_EXACT },
+	{ "mat4_inverse_rigid scalar",    pass_inverse_rigid,    COUNT,       0, DASH_TRIG_EXACT },
+	{ "mat4_inverse_rigid",           pass_inverse_rigid,    COUNT,      -1, DASH_TRIG_EXACT },
+	{ "mat3_normal scalar",           pass_normal,           COUNT,       0, DASH_TRIG_EXACT },
+	{ "mat3_normal",                  pass_normal,           COUNT,      -1, DASH_TRIG_EXACT },
+	{ "frustum_cull_spheres scalar",  pass_cull_spheres,     COUNT,       0, DASH_TRIG_EXACT },
+	{ "frustum_cull_spheres",         pass_cull_spheres,     COUNT,      -1, DASH_TRIG_EXACT },
+	{ "frustum_cull_aabbs scalar",    pass_cull_aabbs,       COUNT,       0, DASH_TRIG_EXACT },
+	{ "frustum_cull_aabbs",           pass_cull_aabbs,       COUNT,      -1, DASH_TRIG_EXACT },
+	{ "dash_float_to_half",           pass_half,             COUNT * 4,  -1, DASH_TRIG_EXACT },
+	{ "dash_float_to_half_batch",     pass_half_batch,       COUNT * 4,  -1, DASH_TRIG_EXACT },
+	{ "transform_update all dirty",   pass_transform_all,    COUNT,      -1, DASH_TRIG_EXACT },
+	{ "transform_update 1% leaves",   pass_transform_sparse, COUNT,      -1, DASH_TRIG_EXACT },
+	{ "dash_image_downsample scalar", pass_downsample,       IMAGE*IMAGE/4, 0, DASH_TRIG_EXACT },
+	{ "dash_image_downsample",        pass_downsample,       IMAGE*IMAGE/4, -1, DASH_TRIG_EXACT },
+	{ "dash_image_transform scalar",  pass_image_transform,  IMAGE*IMAGE, 0,  DASH_TRIG_EXACT },
+	{ "dash_image_transform",         pass_image_transform,  IMAGE*IMAGE, -1, DASH_TRIG_EXACT },
+	{ "dash_texture_load no mips",    pass_texture_load_flat, 1,         -1, DASH_TRIG_EXACT },
+	{ "dash_texture_load",            pass_texture_load,     1,          -1, DASH_TRIG_EXACT },
+	{ "dash_texture_load cpu mips",   pass_texture_load_cpu, 1,          -1, DASH_TRIG_EXACT },
+	{ "dash_texture_acquire cached",  pass_texture_acquire,  1,          -1, DASH_TRIG_EXACT }
+};
+
+/*
+ * bench [--filter name] [--save file.json] [--compare file.json] [--threshold 0.10]
+ *
+ * Checks every SIMD path against its scalar reference, then times the suite.
+ * --save writes the results as a JSON baseline; --compare exits with 2 if
+ * any p50 is more than threshold slower than the baseline, or with 3 if the
+ * baseline can't be read.
+ */
+
+int main(int argc, char *argv[]) {
+
+	int i, j, regressions;
+	const char *filter = NULL, *save = NULL, *baseline = NULL;
+	double threshold = 0.10;
+
+	for(i = 1; i + 1 < argc; i += 2) {
+		if(strcmp(argv[i], "--filter") == 0) {
+			filter = argv[i + 1];
+		} else if(strcmp(argv[i], "--save") == 0) {
+			save = argv[i + 1];
+		} else if(strcmp(argv[i], "--compare") == 0) {
+			baseline = argv[i + 1];
+		} else if(strcmp(argv[i], "--threshold") == 0) {
+			threshold = atof(argv[i + 1]);
+		} else {
+			break;
+		}
+	}
+
+	if(i != argc) {
+		fprintf(stderr, "usage: %s [--filter name] [--save file] [--compare file] [--threshold frac]\n", argv[0]);
+		return 1;
+	}
+
+	srand(1);
+	for(i = 0; i < COUNT; i++) {
+		fill_random(lhs[i]);
+		fill_random(rhs[i]);
+		for(j = 0; j < 3; j++) {
+			pos[j][i] = (float)rand() / RAND_MAX * 20.0f - 10.0f;
+			angle[j][i] = (float)rand() / RAND_MAX * 6.28f;
+			scale[j][i] = (float)rand() / RAND_MAX + 0.5f;
+		}
+	}
+
+	printf("simd kernel: %s\n", dash_simd_name());
+
+	if(!check_multiply() || !check_compose() || !check_sincos() || !check_quat() || !check_inverse() || !check_cull() ||
+		!check_formats() || !check_downsample() || !check_image_transform() || !check_transform()) {
+		return 1;
+	}
+
+	dash_trig_accuracy(DASH_TRIG_FAST);
+	if(!check_compose()) {
+		return 1;
+	}
+	dash_trig_accuracy(DASH_TRIG_EXACT);
+
+	have_gl = init_gl();
+	prepare();
+
+	if(have_gl && (filter == NULL || strstr("dash_texture_load atlas", filter) != NULL)) {
+		measure_atlas();
+	}
+
+	if(have_gl && (filter == NULL || strstr("dash_texture_acquire formats", filter) != NULL)) {
+		report_formats();
+	}
+
+	if(have_gl && (filter == NULL || strstr("dash_texture_load_cooked startup", filter) != NULL)) {
+		measure_cooked();
+	}
+
+	printf("\n%-28s %12s %12s %12s %12s %12s\n", "ns/op", "mean", "p50", "p90", "p99", "min");
+	for(i = 0; i < (int)(sizeof(suite) / sizeof(benchmark)); i++) {
+		if(filter != NULL && strstr(suite[i].name, filter) == NULL) {
+			continue;
+		}
+		if(needs_gl(&suite[i]) && !have_gl) {
+			printf("%-28s skipped, no GL context\n", suite[i].name);
+			continue;
+		}
+		run(&suite[i]);
+		print_result(&results[result_count - 1]);
+	}
+
+	if(save != NULL && !save_results(save)) {
+		return 1;
+	}
+
+	if(baseline != NULL) {
+		regressions = compare_results(baseline, threshold);
+		if(regressions < 0) {
+			return 3;
+		}
+		return regressions == 0 ? 0 : 2;
+	}
+
+	return 0;
+
+}
+
+// World matrix of node i by walking up to the root, for checking
+void world_brute(int i, mat4 m) {
+
+	mat4 local;
+
+	mat4_compose_quat(tree.translation[i], tree.rotation[i], tree.scale[i], m);
+	for(i = tree.parent[i]; i >= 0; i = tree.parent[i]) {
+		mat4_compose_quat(tree.translation[i], tree.rotation[i], tree.scale[i], local);
+		mat4_multiply_scalar(local, m, m);
+	}
+
+}
+
+bool check_transform() {
+
+	int i, n, expected;
+	int touched[COUNT];
+	vec3 t, sc;
+
+	if(!transform_tree_init(&tree, 4)) {
+		return false;
+	}
+
+	// Shallow random forest: a few roots, every other node hangs off an
+	// earlier one, and scales stay near 1 so deep chains keep precision
+	for(i = 0; i < COUNT; i++) {
+		transform_add(&tree, i < 4 ? -1 : i - 1 - rand() % (i < 64 ? i : 64));
+		t[0] = pos[0][i] * 0.1f;
+		t[1] = pos[1][i] * 0.1f;
+		t[2] = pos[2][i] * 0.1f;
+		sc[0] = sc[1] = sc[2] = 0.9f + scale[0][i] * 0.1f;
+		transform_set_translation(&tree, i, t);
+		transform_set_rotation(&tree, i, qa[i]);
+		transform_set_scale(&tree, i, sc);
+	}
+
+	if(transform_update(&tree) != COUNT || transform_update(&tree) != 0) {
+		fprintf(stderr, "transform_update recomputed the wrong number of nodes\n");
+		return false;
+	}
+
+	// Touch one node: it and all of its descendants must be rebuilt
+	transform_set_rotation(&tree, 100, qb[100]);
+	expected = 0;
+	for(i = 100; i < COUNT; i++) {
+		touched[i] = i == 100 || (tree.parent[i] >= 100 && touched[tree.parent[i]]);
+		expected += touched[i];
+	}
+
+	n = transform_update(&tree);
+	if(n != expected) {
+		fprintf(stderr, "transform_update rebuilt %d nodes, subtree has %d\n", n, expected);
+		return false;
+	}
+
+	for(i = 0; i < COUNT; i++) {
+		world_brute(i, ref[i]);
+	}
+
+	// Nodes nobody points at, for timing updates that touch no subtree
+	memset(touched, 0, sizeof(touched));
+	for(i = 0; i < COUNT; i++) {
+		if(tree.parent[i] >= 0) {
+			touched[tree.parent[i]] = 1;
+		}
+	}
+	leaf_count = 0;
+	for(i = 0; i < COUNT; i++) {
+		if(!touched[i]) {
+			leaves[leaf_count++] = i;
+		}
+	}
+
+	return compare("transform_update", tree.world, ref, COUNT);
+
+}
+
+double now() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+
+}
+
+void fill_random(mat4 m) {
+
+	int i;
+	for(i = 0; i < 16; i++) {
+		m[i] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+	}
+
+}
+
+bool compare_floats(const char *name, float *a, float *b, int count) {
+
+	int i;
+	float diff, scale;
+
+	for(i = 0; i < count; i++) {
+		scale = fabsf(b[i]) > 1.0f ? fabsf(b[i]) : 1.0f;
+		diff = fabsf(a[i] - b[i]);
+		if(diff > TOLERANCE * scale) {
+			fprintf(stderr, "%s mismatch at %d: %f != %f\n", name, i, a[i], b[i]);
+			return false;
+		}
+	}
+
+	printf("%s matches reference (%d floats)\n", name, count);
+	return true;
+
+}
+
+bool compare(const char *name, mat4 *a, mat4 *b, int count) {
+
+	return compare_floats(name, a[0], b[0], count * 16);
+
+}
+
+// The identity, translate, rotate and multiply chain from logic()
+void compose_chain(int i, mat4 m) {
+
+	mat4 pos_m, rot_m, rot_x, rot_y, rot_z;
+	vec3 t = { pos[0][i], pos[1][i], pos[2][i] };
+
+	mat4_translate(t, pos_m);
+	mat4_rotate_x(angle[0][i], rot_x);
+	mat4_rotate_y(angle[1][i], rot_y);
+	mat4_rotate_z(angle[2][i], rot_z);
+	mat4_multiply(rot_x, rot_y, rot_m);
+	mat4_multiply(rot_m, rot_z, rot_m);
+
+	mat4_identity(m);
+	mat4_multiply(m, pos_m, m);
+	mat4_multiply(m, rot_m, m);
+
+}
+
+void compose_fused(int i, mat4 m) {
+
+	vec3 t = { pos[0][i], pos[1][i], pos[2][i] };
+	vec3 r = { angle[0][i], angle[1][i], angle[2][i] };
+
+	mat4_compose(t, r, NULL, m);
+
+}
+
+bool check_multiply() {
+
+	int i;
+
+	for(i = 0; i < COUNT; i++) {
+		mat4_multiply_scalar(lhs[i], rhs[i], ref[i]);
+		mat4_multiply(lhs[i], rhs[i], out[i]);
+	}
+
+	if(!compare("mat4_multiply", out, ref, COUNT)) {
+		return false;
+	}
+
+	// Results must not change when the output aliases an input
+	for(i = 0; i < COUNT; i++) {
+		mat4_copy(lhs[i], out[i]);
+		mat4_multiply(out[i], rhs[i], out[i]);
+	}
+
+	if(!compare("mat4_multiply (aliased)", out, ref, COUNT)) {
+		return false;
+	}
+
+	mat4_multiply_batch(lhs, rhs, out, COUNT);
+	return compare("mat4_multiply_batch", out, ref, COUNT);
+
+}
+
+bool check_compose() {
+
+	int i;
+	mat4 sc;
+	vec3_soa t = { pos[0], pos[1], pos[2] };
+	vec3_soa r = { angle[0], angle[1], angle[2] };
+	vec3_soa s = { scale[0], scale[1], scale[2] };
+	vec3_soa unit = { NULL, NULL, NULL };
+
+	for(i = 0; i < COUNT; i++) {
+		compose_chain(i, ref[i]);
+		compose_fused(i, out[i]);
+	}
+
+	if(!compare("mat4_compose", out, ref, COUNT)) {
+		return false;
+	}
+
+	// Odd count exercises the partial block at the end
+	mat4_compose_batch(t, r, unit, out, COUNT - 3);
+	if(!compare("mat4_compose_batch", out, ref, COUNT - 3)) {
+		return false;
+	}
+
+	for(i = 0; i < COUNT; i++) {
+		mat4_identity(sc);
+		sc[M_00] = scale[0][i];
+		sc[M_11] = scale[1][i];
+		sc[M_22] = scale[2][i];
+		mat4_multiply_scalar(ref[i], sc, ref[i]);
+	}
+
+	mat4_compose_batch(t, r, s, out, COUNT);
+	return compare("mat4_compose_batch (scaled)", out, ref, COUNT);
+
+}
+
+bool check_sincos() {
+
+	int i;
+	float x, s, c, err, max_err;
+
+	dash_trig_accuracy(DASH_TRIG_FAST);
+	max_err = 0.0f;
+
+	for(i = -200000; i <= 200000; i++) {
+		x = i * 0.0005f;
+		dash_sincosf(x, &s, &c);
+		err = fabsf(s - (float)sin(x));
+		max_err = err > max_err ? err : max_err;
+		err = fabsf(c - (float)cos(x));
+		max_err = err > max_err ? err : max_err;
+	}
+
+	for(i = 0; i < COUNT; i++) {
+		angle[0][i] -= 3.14f;
+	}
+
+	dash_sincosf_batch(angle[0], sin_out, cos_out, COUNT);
+	for(i = 0; i < COUNT; i++) {
+		dash_sincosf(angle[0][i], &s, &c);
+		if(s != sin_out[i] && fabsf(s - sin_out[i]) > TOLERANCE) {
+			max_err = 1.0f;
+		}
+		if(c != cos_out[i] && fabsf(c - cos_out[i]) > TOLERANCE) {
+			max_err = 1.0f;
+		}
+	}
+
+	for(i = 0; i < COUNT; i++) {
+		angle[0][i] += 3.14f;
+	}
+
+	dash_trig_accuracy(DASH_TRIG_EXACT);
+
+	if(max_err > 2e-6f) {
+		fprintf(stderr, "dash_sincosf fast max error %g\n", max_err);
+		return false;
+	}
+
+	printf("dash_sincosf fast max error %g on [-100, 100]\n", max_err);
+	return true;
+
+}
+
+bool check_quat() {
+
+	int i;
+	vec3 r, t;
+
+	for(i = 0; i < COUNT; i++) {
+		r[0] = angle[0][i];
+		r[1] = angle[1][i];
+		r[2] = angle[2][i];
+		mat4_rotate(r, ref[i]);
+		quat_from_euler(r, qa[i]);
+		mat4_from_quat(qa[i], out[i]);
+
+		r[0] = angle[2][i];
+		r[1] = angle[0][i];
+		r[2] = angle[1][i];
+		quat_from_euler(r, qb[i]);
+		blend[i] = (float)i / COUNT;
+	}
+
+	if(!compare("mat4_from_quat", out, ref, COUNT)) {
+		return false;
+	}
+
+	mat4_from_quat_batch(qa, out, COUNT - 1);
+	if(!compare("mat4_from_quat_batch", out, ref, COUNT - 1)) {
+		return false;
+	}
+
+	for(i = 0; i < COUNT; i++) {
+		quat_multiply(qa[i], qb[i], qref[i]);
+	}
+	quat_multiply_batch(qa, qb, qout, COUNT);
+	if(!compare_floats("quat_multiply_batch", qout[0], qref[0], COUNT * 4)) {
+		return false;
+	}
+
+	for(i = 0; i < COUNT; i++) {
+		quat_nlerp(qa[i], qb[i], blend[i], qref[i]);
+	}
+	quat_nlerp_batch(qa, qb, blend, qout, COUNT);
+	if(!compare_floats("quat_nlerp_batch", qout[0], qref[0], COUNT * 4)) {
+		return false;
+	}
+
+	for(i = 0; i < COUNT; i++) {
+		quat_slerp(qa[i], qb[i], blend[i], qref[i]);
+	}
+	quat_slerp_batch(qa, qb, blend, qout, COUNT);
+	if(!compare_floats("quat_slerp_batch", qout[0], qref[0], COUNT * 4)) {
+		return false;
+	}
+
+	for(i = 0; i < COUNT; i++) {
+		t[0] = pos[0][i];
+		t[1] = pos[1][i];
+		t[2] = pos[2][i];
+		mat4_compose_quat(t, qa[i], NULL, ref[i]);
+		dquat_from_rigid(qa[i], t, da[i]);
+		dquat_from_rigid(qb[i], t, db[i]);
+		mat4_from_dquat(da[i], out[i]);
+	}
+
+	if(!compare("mat4_from_dquat", out, ref, COUNT)) {
+		return false;
+	}
+
+	mat4_from_dquat_batch(da, out, COUNT);
+	if(!compare("mat4_from_dquat_batch", out, ref, COUNT)) {
+		return false;
+	}
+
+	for(i = 0; i < COUNT; i++) {
+		mat4_from_dquat(db[i], rhs[i]);
+		mat4_multiply_scalar(ref[i], rhs[i], ref[i]);
+		dquat_multiply(da[i], db[i], dref[i]);
+		mat4_from_dquat(dref[i], out[i]);
+	}
+
+	if(!compare("dquat_multiply", out, ref, COUNT)) {
+		return false;
+	}
+
+	dquat_multiply_batch(da, db, dout, COUNT);
+	if(!compare_floats("dquat_multiply_batch", dout[0], dref[0], COUNT * 8)) {
+		return false;
+	}
+
+	for(i = 0; i < COUNT; i++) {
+		dquat_nlerp(da[i], db[i], blend[i], dref[i]);
+	}
+	dquat_nlerp_batch(da, db, blend, dout, COUNT);
+	if(!compare_floats("dquat_nlerp_batch", dout[0], dref[0], COUNT * 8)) {
+		return false;
+	}
+
+	for(i = 0; i < COUNT; i++) {
+		vec3 p = { pos[1][i], pos[2][i], pos[0][i] };
+		mat4_from_dquat(da[i], out[i]);
+		dquat_transform_point(da[i], p, qout[i]);
+		qref[i][0] = out[i][M_00]*p[0] + out[i][M_01]*p[1] + out[i][M_02]*p[2] + out[i][M_03];
+		qref[i][1] = out[i][M_10]*p[0] + out[i][M_11]*p[1] + out[i][M_12]*p[2] + out[i][M_13];
+		qref[i][2] = out[i][M_20]*p[0] + out[i][M_21]*p[1] + out[i][M_22]*p[2] + out[i][M_23];
+		qref[i][3] = qout[i][3];
+	}
+
+	if(!compare_floats("dquat_transform_point", qout[0], qref[0], COUNT * 4)) {
+		return false;
+	}
+
+	return true;
+
+}
+
+bool check_identity(const char *name, mat4 *a, mat4 *inv) {
+
+	int i, j;
+	mat4 id;
+
+	for(i = 0; i < COUNT; i++) {
+		mat4_multiply_scalar(a[i], inv[i], id);
+		for(j = 0; j < 16; j++) {
+			if(fabsf(id[j] - (j % 5 == 0 ? 1.0f : 0.0f)) > 1e-3f) {
+				fprintf(stderr, "%s: m * inverse(m) is not identity at %d[%d]: %f\n",
+					name, i, j, id[j]);
+				return false;
+			}
+		}
+	}
+
+	return true;
+
+}
+
+bool check_inverse_pass(const char *name) {
+
+	int i, j;
+	mat3 n;
+	vec3 t, r, sc;
+
+	for(i = 0; i < COUNT; i++) {
+		if(!mat4_inverse(lhs[i], out[i])) {
+			fprintf(stderr, "%s: mat4_inverse reported a singular matrix\n", name);
+			return false;
+		}
+	}
+
+	if(!check_identity("mat4_inverse", lhs, out)) {
+		return false;
+	}
+
+	for(i = 0; i < COUNT; i++) {
+		t[0] = pos[0][i];
+		t[1] = pos[1][i];
+		t[2] = pos[2][i];
+		r[0] = angle[0][i];
+		r[1] = angle[1][i];
+		r[2] = angle[2][i];
+		sc[0] = scale[0][i];
+		sc[1] = scale[1][i];
+		sc[2] = scale[2][i];
+
+		mat4_compose(t, r, sc, ref[i]);
+		mat4_inverse_affine(ref[i], out[i]);
+
+		mat3_normal(ref[i], n);
+		for(j = 0; j < 9; j++) {
+			// Normal matrix is the transposed upper 3x3 of the inverse
+			if(fabsf(n[j] - out[i][(j % 3) * 4 + j / 3]) > 1e-4f) {
+				fprintf(stderr, "%s: mat3_normal mismatch at %d[%d]\n", name, i, j);
+				return false;
+			}
+		}
+	}
+
+	if(!check_identity("mat4_inverse_affine", ref, out)) {
+		return false;
+	}
+
+	for(i = 0; i < COUNT; i++) {
+		t[0] = pos[0][i];
+		t[1] = pos[1][i];
+		t[2] = pos[2][i];
+		r[0] = angle[0][i];
+		r[1] = angle[1][i];
+		r[2] = angle[2][i];
+		mat4_compose(t, r, NULL, ref[i]);
+		mat4_inverse_rigid(ref[i], out[i]);
+	}
+
+	if(!check_identity("mat4_inverse_rigid", ref, out)) {
+		return false;
+	}
+
+	mat4_identity(ref[0]);
+	ref[0][M_11] = 0.0f;
+	if(mat4_inverse(ref[0], out[0]) || mat4_inverse_affine(ref[0], out[0]) || mat3_normal(ref[0], n)) {
+		fprintf(stderr, "%s: singular matrix was inverted\n", name);
+		return false;
+	}
+
+	printf("%s inverses match identity (%d matrices)\n", name, COUNT);
+	return true;
+
+}
+
+bool check_inverse() {
+
+	bool ok;
+
+	dash_cpu_override(0);
+	ok = check_inverse_pass("scalar");
+	dash_cpu_override(-1);
+
+	return ok && check_inverse_pass(dash_simd_name());
+
+}
+
+// Compares the visible list against the scalar kernel
+bool check_cull_pass(const char *name, bool aabb, int count) {
+
+	int i, n, n_ref;
+	vec3_soa c = { pos[0], pos[1], pos[2] };
+	vec3_soa e = { bounds[0], bounds[1], bounds[2] };
+
+	if(aabb) {
+		dash_cpu_override(0);
+		n_ref = frustum_cull_aabbs(cam.planes, c, e, count, visible_ref);
+		dash_cpu_override(-1);
+		n = frustum_cull_aabbs(cam.planes, c, e, count, visible);
+	} else {
+		dash_cpu_override(0);
+		n_ref = frustum_cull_spheres(cam.planes, c, bounds[3], count, visible_ref);
+		dash_cpu_override(-1);
+		n = frustum_cull_spheres(cam.planes, c, bounds[3], count, visible);
+	}
+
+	if(n != n_ref) {
+		fprintf(stderr, "%s: %d visible, scalar found %d\n", name, n, n_ref);
+		return false;
+	}
+
+	for(i = 0; i < n; i++) {
+		if(visible[i] != visible_ref[i]) {
+			fprintf(stderr, "%s: visible[%d] = %d, scalar has %d\n", name, i, visible[i], visible_ref[i]);
+			return false;
+		}
+	}
+
+	if(n == 0 || n == count) {
+		fprintf(stderr, "%s: expected a partial result, got %d of %d\n", name, n, count);
+		return false;
+	}
+
+	printf("%s matches scalar (%d of %d visible)\n", name, n, count);
+	return true;
+
+}
+
+bool check_cull() {
+
+	int i;
+	bool ok;
+	vec3 eye = { 0.0f, 2.0f, 0.0f };
+	vec3 target = { 0.0f, 0.0f, -4.0f };
+	vec3 axis = { 0.0f, 1.0f, 0.0f };
+
+	mat4_perspective(45.0f, 800.0f / 600.0f, 0.1f, 10.0f, cam.projection);
+	mat4_look_at(eye, target, axis, cam.view);
+	camera_update(&cam);
+
+	// pos holds sphere centers and aabb minimums
+	for(i = 0; i < COUNT; i++) {
+		bounds[0][i] = pos[0][i] + angle[0][i] * 0.2f;
+		bounds[1][i] = pos[1][i] + angle[1][i] * 0.2f;
+		bounds[2][i] = pos[2][i] + angle[2][i] * 0.2f;
+		bounds[3][i] = angle[0][i] * 0.2f;
+	}
+
+	ok = check_cull_pass("frustum_cull_aabbs", true, COUNT - 5);
+	return ok && check_cull_pass("frustum_cull_spheres", false, COUNT - 3);
+
+}
+
+bool check_formats() {
+
+	int i, n;
+	short s16[COUNT * 4];
+	unsigned short u16[COUNT * 4];
+	signed char s8[COUNT * 4];
+	unsigned char u8[COUNT * 4];
+	float specials[] = { 0.0f, -0.0f, 1.0f, -1.0f, 65504.0f, 65520.0f, 1e-7f, -6e-8f,
+		3e-5f, 1e9f, INFINITY, -INFINITY, 0.5f, 2.0f, 0.99998f, -1.00001f };
+
+	n = COUNT * 4;
+	for(i = 0; i < n; i++) {
+		values[i] = ((float)rand() / RAND_MAX * 2.0f - 1.0f) * (i % 3 ? 1.2f : 7000.0f);
+	}
+	memcpy(values, specials, sizeof(specials));
+
+	// Every finite half must survive a round trip through float
+	for(i = 0; i < 65536; i++) {
+		if((i & 0x7c00) == 0x7c00 && (i & 0x3ff)) {
+			continue;
+		}
+		if(dash_float_to_half(dash_half_to_float(i)) != i) {
+			fprintf(stderr, "half 0x%04x does not round trip\n", i);
+			return false;
+		}
+	}
+
+	for(i = 0; i < n; i++) {
+		halves_ref[i] = dash_float_to_half(values[i]);
+	}
+	dash_float_to_half_batch(values, halves, n - 3);
+	halves[n - 3] = halves_ref[n - 3];
+	halves[n - 2] = halves_ref[n - 2];
+	halves[n - 1] = halves_ref[n - 1];
+	if(memcmp(halves, halves_ref, sizeof(halves)) != 0) {
+		fprintf(stderr, "dash_float_to_half_batch differs from scalar\n");
+		return false;
+	}
+
+	dash_half_to_float_batch(halves, decoded, n);
+	for(i = 0; i < n; i++) {
+		if(memcmp(&decoded[i], &(float){ dash_half_to_float(halves[i]) }, sizeof(float)) != 0) {
+			fprintf(stderr, "dash_half_to_float_batch differs at %d\n", i);
+			return false;
+		}
+	}
+
+	dash_float_to_snorm16_batch(values, s16, n);
+	dash_float_to_unorm16_batch(values, u16, n);
+	dash_float_to_snorm8_batch(values, s8, n);
+	dash_float_to_unorm8_batch(values, u8, n);
+	for(i = 0; i < n; i++) {
+		if(s16[i] != dash_float_to_snorm16(values[i]) || u16[i] != dash_float_to_unorm16(values[i]) ||
+			s8[i] != dash_float_to_snorm8(values[i]) || u8[i] != dash_float_to_unorm8(values[i])) {
+			fprintf(stderr, "normalized batch differs from scalar at %d (%f)\n", i, values[i]);
+			return false;
+		}
+	}
+
+	if(dash_float_to_snorm16(-1.5f) != -32767 || dash_float_to_unorm8(0.5f) != 128 ||
+		dash_pack_snorm_2_10_10_10(1.0f, -1.0f, 0.0f, -1.0f) != 0xc00805ff) {
+		fprintf(stderr, "normalized conversion does not follow the GL rules\n");
+		return false;
+	}
+
+	dash_pack_snorm_2_10_10_10_batch(values, packed, COUNT);
+	for(i = 0; i < COUNT; i++) {
+		packed_ref[i] = dash_pack_snorm_2_10_10_10(values[i*4], values[i*4 + 1], values[i*4 + 2], values[i*4 + 3]);
+	}
+	if(memcmp(packed, packed_ref, sizeof(packed)) != 0) {
+		fprintf(stderr, "dash_pack_snorm_2_10_10_10_batch differs from scalar\n");
+		return false;
+	}
+
+	dash_pack_unorm_2_10_10_10_batch(values, packed, COUNT - 1);
+	for(i = 0; i < COUNT - 1; i++) {
+		if(packed[i] != dash_pack_unorm_2_10_10_10(values[i*4], values[i*4 + 1], values[i*4 + 2], values[i*4 + 3])) {
+			fprintf(stderr, "dash_pack_unorm_2_10_10_10_batch differs at %d\n", i);
+			return false;
+		}
+	}
+
+	printf("vertex formats match scalar (%d values)\n", n);
+	return true;
+
+}
+
+// Odd sizes and both channel counts exercise the scalar edges and tails
+bool check_downsample() {
+
+	int i, j, c, dw, dh;
+	static const int sizes[][2] = {
+		{ IMAGE, IMAGE }, { 37, 5 }, { 1, 9 }, { 8, 1 }, { 3, 3 }, { 1, 64 }, { 64, 1 }
+	};
+
+	for(i = 0; i < IMAGE * IMAGE * 4; i++) {
+		image[i] = (unsigned char)rand();
+	}
+
+	for(i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+		for(c = 3; c <= 4; c++) {
+			dw = sizes[i][0] > 1 ? sizes[i][0] / 2 : 1;
+			dh = sizes[i][1] > 1 ? sizes[i][1] / 2 : 1;
+			dash_image_downsample(image, sizes[i][0], sizes[i][1], c, image_half);
+			dash_cpu_override(0);
+			dash_image_downsample(image, sizes[i][0], sizes[i][1], c, image_ref);
+			dash_cpu_override(-1);
+			for(j = 0; j < dw * dh * c; j++) {
+				if(image_half[j] != image_ref[j]) {
+					fprintf(stderr, "dash_image_downsample %dx%dx%d mismatch at %d: %d != %d\n",
+						sizes[i][0], sizes[i][1], c, j, image_half[j], image_ref[j]);
+					return false;
+				}
+			}
+		}
+	}
+
+	printf("dash_image_downsample matches scalar\n");
+	return true;
+
+}
+
+bool check_image_transform() {
+
+	int i, j, c, f, t, size;
+	int flags = DASH_IMAGE_FLIP_Y | DASH_IMAGE_PREMULTIPLY | DASH_IMAGE_SWAP_RB;
+
+	for(i = 0; i < IMAGE * IMAGE * 4; i++) {
+		image[i] = (unsigned char)rand();
+	}
+
+	// Every flag combination over an odd size, so the scalar tail runs too
+	for(f = 0; f <= flags; f++) {
+		for(c = 1; c <= 4; c++) {
+			size = 37 * 5 * c;
+			memcpy(image_half, image, size);
+			memcpy(image_ref, image, size);
+			dash_image_transform(image_half, 37, 5, c, f);
+			dash_cpu_override(0);
+			dash_image_transform(image_ref, 37, 5, c, f);
+			dash_cpu_override(-1);
+			for(j = 0; j < size; j++) {
+				if(image_half[j] != image_ref[j]) {
+					fprintf(stderr, "dash_image_transform %d channels flags %d mismatch at %d: %d != %d\n",
+						c, f, j, image_half[j], image_ref[j]);
+					return false;
+				}
+			}
+		}
+	}
+
+	// Premultiplied color must equal round(c * a / 255)
+	memcpy(image_ref, image, 37 * 4);
+	dash_image_transform(image_ref, 37, 1, 4, DASH_IMAGE_PREMULTIPLY);
+	for(j = 0; j < 37 * 4; j++) {
+		t = j % 4 == 3 ? image[j] : (image[j] * image[j | 3] * 2 + 255) / 510;
+		if(image_ref[j] != t) {
+			fprintf(stderr, "dash_image_transform premultiply at %d: %d != %d\n", j, image_ref[j], t);
+			return false;
+		}
+	}
+
+	printf("dash_image_transform matches scalar\n");
+	return true;
+
+}
+
+// Hidden window for dash_texture_load; the math benchmarks need no context
+bool init_gl() {
+
+	SDL_Window *window;
+
+	if(SDL_Init(SDL_INIT_VIDEO) != 0) {
+		return false;
+	}
+
+	window = SDL_CreateWindow(
+		"bench",
+		SDL_WINDOWPOS_CENTERED,
+		SDL_WINDOWPOS_CENTERED,
+		64,
+		64,
+		SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL
+	);
+
+	if(window == NULL || SDL_GL_CreateContext(window) == NULL) {
+		return false;
+	}
+
+	return glewInit() == GLEW_OK;
+
+}
+
+// Inputs for the inverse, normal and culling passes
+void prepare() {
+
+	int i;
+	vec3 t, s;
+
+	for(i = 0; i < COUNT; i++) {
+		t[0] = pos[0][i];
+		t[1] = pos[1][i];
+		t[2] = pos[2][i];
+		s[0] = scale[0][i];
+		s[1] = scale[1][i];
+		s[2] = scale[2][i];
+		mat4_compose_quat(t, qa[i], s, ref[i]);
+	}
+
+}
+
+void run(benchmark *b) {
+
+	int i;
+	double start, samples[SAMPLES];
+	result *r;
+
+	if(result_count == MAX_RESULTS) {
+		return;
+	}
+
+	dash_cpu_override(b->features);
+	dash_trig_accuracy(b->accuracy);
+
+	for(i = 0; i < WARMUP; i++) {
+		b->pass();
+	}
+
+	for(i = 0; i < SAMPLES; i++) {
+		start = now();
+		b->pass();
+		samples[i] = (now() - start) / b->ops;
+	}
+
+	dash_cpu_override(-1);
+	dash_trig_accuracy(DASH_TRIG_EXACT);
+
+	r = &results[result_count++];
+	snprintf(r->name, sizeof(r->name), "%s", b->name);
+
+	r->mean = 0.0;
+	for(i = 0; i < SAMPLES; i++) {
+		r->mean += samples[i] / SAMPLES;
+	}
+
+	qsort(samples, SAMPLES, sizeof(double), compare_doubles);
+	r->min = samples[0];
+	r->p50 = samples[SAMPLES * 50 / 100];
+	r->p90 = samples[SAMPLES * 90 / 100];
+	r->p99 = samples[SAMPLES * 99 / 100];
+
+}
+
+int compare_doubles(const void *a, const void *b) {
+
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+
+	return (x > y) - (x < y);
+
+}
+
+void print_result(result *r) {
+
+	printf("%-28s %12.2f %12.2f %12.2f %12.2f %12.2f\n", r->name, r->mean, r->p50, r->p90, r->p99, r->min);
+
+}
+
+// One result per line so compare_results can read it back with sscanf
+bool save_results(const char *filename) {
+
+	int i;
+	FILE *fp;
+
+	fp = fopen(filename, "w");
+	if(fp == NULL) {
+		fprintf(stderr, "Could not open %s for writing\n", filename);
+		return false;
+	}
+
+	fprintf(fp, "{\n\t\"simd\": \"%s\",\n\t\"results\": [\n", dash_simd_name());
+	for(i = 0; i < result_count; i++) {
+		fprintf(fp, "\t\t{ \"name\": \"%s\", \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"min\": %.3f }%s\n",
+			results[i].name, results[i].mean, results[i].p50, results[i].p90,
+			results[i].p99, results[i].min, i + 1 < result_count ? "," : "");
+	}
+	fprintf(fp, "\t]\n}\n");
+
+	fclose(fp);
+	printf("saved %d results to %s\n", result_count, filename);
+	return true;
+
+}
+
+// Returns the number of benchmarks whose p50 regressed past threshold
+int compare_results(const char *filename, double threshold) {
+
+	int i, regressions;
+	FILE *fp;
+	char line[512], name[64];
+	double mean, p50;
+
+	fp = fopen(filename, "r");
+	if(fp == NULL) {
+		fprintf(stderr, "Could not open %s for reading\n", filename);
+		return -1;
+	}
+
+	printf("\n%-28s %12s %12s %9s\n", "vs baseline", "p50", "base", "change");
+
+	regressions = 0;
+	while(fgets(line, sizeof(line), fp) != NULL) {
+		if(sscanf(line, " { \"name\": \"%63[^\"]\", \"mean\": %lf, \"p50\": %lf", name, &mean, &p50) != 3) {
+			continue;
+		}
+		for(i = 0; i < result_count; i++) {
+			if(strcmp(results[i].name, name) != 0) {
+				continue;
+			}
+			printf("%-28s %12.2f %12.2f %+8.1f%%%s\n", name, results[i].p50, p50,
+				(results[i].p50 / p50 - 1.0) * 100.0,
+				results[i].p50 > p50 * (1.0 + threshold) ? " REGRESSION" : "");
+			if(results[i].p50 > p50 * (1.0 + threshold)) {
+				regressions++;
+			}
+		}
+	}
+
+	fclose(fp);
+	return regressions;
+
+}
+
+void pass_multiply_scalar() {
+
+	int i;
+
+	for(i = 0; i < COUNT; i++) {
+		mat4_multiply_scalar(lhs[i], rhs[i], out[i]);
+	}
+
+}
+
+void pass_multiply() {
+
+	int i;
+
+	for(i = 0; i < COUNT; i++) {
+		mat4_multiply(lhs[i], rhs[i], out[i]);
+	}
+
+}
+
+void pass_multiply_batch() {
+
+	mat4_multiply_batch(lhs, rhs, out, COUNT);
+
+}
+
+void pass_rotate() {
+
+	int i;
+
+	for(i = 0; i < COUNT; i++) {
+		vec3 r = { angle[0][i], angle[1][i], angle[2][i] };
+		mat4_rotate(r, out[i]);
+	}
+
+}
+
+void pass_look_at() {
+
+	int i;
+	vec3 center = { 0.0f, 0.0f, 0.0f };
+	vec3 up = { 0.0f, 1.0f, 0.0f };
+
+	for(i = 0; i < COUNT; i++) {
+		// mat4_look_at negates eye in place, so rebuild it each time
+		vec3 eye = { pos[0][i], pos[1][i], pos[2][i] };
+		mat4_look_at(eye, center, up, out[i]);
+	}
+
+}
+
+void pass_perspective() {
+
+	int i;
+
+	for(i = 0; i < COUNT; i++) {
+		mat4_perspective(angle[0][i] * 0.25f + 0.2f, scale[0][i], 0.1f, 100.0f, out[i]);
+	}
+
+}
+
+void pass_normalize() {
+
+	int i;
+	vec3 v;
+
+	for(i = 0; i < COUNT; i++) {
+		vec3 a = { pos[0][i], pos[1][i], pos[2][i] };
+		vec3_normalize(a, v);
+		out[i][0] = v[0];
+	}
+
+}
+
+void pass_compose_chain() {
+
+	int i;
+
+	for(i = 0; i < COUNT; i++) {
+		compose_chain(i, out[i]);
+	}
+
+}
+
+void pass_compose() {
+
+	int i;
+
+	for(i = 0; i < COUNT; i++) {
+		compose_fused(i, out[i]);
+	}
+
+}
+
+void pass_compose_batch() {
+
+	vec3_soa t = { pos[0], pos[1], pos[2] };
+	vec3_soa a = { angle[0], angle[1], angle[2] };
+	vec3_soa s = { NULL, NULL, NULL };
+
+	mat4_compose_batch(t, a, s, out, COUNT);
+
+}
+
+void pass_sincos_libm() {
+
+	int i;
+	float acc = 0.0f;
+
+	for(i = 0; i < COUNT; i++) {
+		acc += sin(angle[0][i]) + cos(angle[0][i]);
+	}
+
+	sink = acc;
+
+}
+
+void pass_sincos() {
+
+	int i;
+	float s, c, acc = 0.0f;
+
+	for(i = 0; i < COUNT; i++) {
+		dash_sincosf(angle[0][i], &s, &c);
+		acc += s + c;
+	}
+
+	sink = acc;
+
+}
+
+void pass_sincos_batch() {
+
+	dash_sincosf_batch(angle[0], sin_out, cos_out, COUNT);
+
+}
+
+void pass_slerp() {
+
+	int i;
+
+	for(i = 0; i < COUNT; i++) {
+		quat_slerp(qa[i], qb[i], blend[i], qout[i]);
+	}
+
+}
+
+void pass_slerp_batch() {
+
+	quat_slerp_batch(qa, qb, blend, qout, COUNT);
+
+}
+
+void pass_inverse() {
+
+	int i;
+
+	for(i = 0; i < COUNT; i++) {
+		mat4_inverse(ref[i], out[i]);
+	}
+
+}
+
+void pass_inverse_affine() {
+
+	int i;
+
+	for(i = 0; i < COUNT; i++) {
+		mat4_inverse_affine(ref[i], out[i]);
+	}
+
+}
+
+void pass_inverse_rigid() {
+
+	int i;
+
+	for(i = 0; i < COUNT; i++) {
+		mat4_inverse_rigid(ref[i], out[i]);
+	}
+
+}
+
+void pass_normal() {
+
+	int i;
+	mat3 n;
+
+	for(i = 0; i < COUNT; i++) {
+		mat3_normal(ref[i], n);
+		out[i][0] = n[0];
+	}
+
+}
+
+void pass_cull_spheres() {
+
+	vec3_soa c = { pos[0], pos[1], pos[2] };
+
+	visible[0] = frustum_cull_spheres(cam.planes, c, bounds[3], COUNT, visible);
+
+}
+
+void pass_cull_aabbs() {
+
+	vec3_soa c = { pos[0], pos[1], pos[2] };
+	vec3_soa e = { bounds[0], bounds[1], bounds[2] };
+
+	visible[0] = frustum_cull_aabbs(cam.planes, c, e, COUNT, visible);
+
+}
+
+void pass_half() {
+
+	int i;
+
+	for(i = 0; i < COUNT * 4; i++) {
+		halves[i] = dash_float_to_half(values[i]);
+	}
+
+}
+
+void pass_half_batch() {
+
+	dash_float_to_half_batch(values, halves, COUNT * 4);
+
+}
+
+// Test image written one row at a time, so writing a large one does not
+// raise the peak RSS that measure_atlas reports. Palette images get a 256
+// entry ramp, and with trns a transparency chunk as well.
+bool write_png(const char *filename, int size, int color_type, int bit_depth, bool trns) {
+
+	int x, y, b, c, channels, bytes;
+	FILE *fp;
+	png_structp png_ptr;
+	png_infop info_ptr;
+	png_color palette[256];
+	png_byte alpha[256];
+	png_color_16 grey_key = { 0, 0, 0, 0, 0 };
+	unsigned char *row;
+
+	channels = color_type == PNG_COLOR_TYPE_RGBA ? 4 : color_type == PNG_COLOR_TYPE_RGB ? 3 :
+		color_type == PNG_COLOR_TYPE_GRAY_ALPHA ? 2 : 1;
+	bytes = bit_depth == 16 ? 2 : 1;
+
+	fp = fopen(filename, "wb");
+	row = (unsigned char*)malloc(size * channels * bytes);
+	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	info_ptr = png_ptr ? png_create_info_struct(png_ptr) : NULL;
+	if(fp == NULL || row == NULL || info_ptr == NULL || setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_write_struct(&png_ptr, info_ptr ? &info_ptr : NULL);
+		if(fp != NULL) {
+			fclose(fp);
+		}
+		free(row);
+		return false;
+	}
+
+	png_init_io(png_ptr, fp);
+	png_set_compression_level(png_ptr, 1);
+	png_set_IHDR(png_ptr, info_ptr, size, size, bit_depth, color_type,
+		PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+	if(color_type == PNG_COLOR_TYPE_PALETTE) {
+		for(x = 0; x < 256; x++) {
+			palette[x].red = (png_byte)x;
+			palette[x].green = (png_byte)(255 - x);
+			palette[x].blue = (png_byte)(x * 7);
+			alpha[x] = (png_byte)(x ^ 0x55);
+		}
+		png_set_PLTE(png_ptr, info_ptr, palette, 256);
+		if(trns) {
+			png_set_tRNS(png_ptr, info_ptr, alpha, 256, NULL);
+		}
+	} else if(trns) {
+		png_set_tRNS(png_ptr, info_ptr, NULL, 0, &grey_key);
+	}
+	png_write_info(png_ptr, info_ptr);
+
+	for(y = 0; y < size; y++) {
+		for(x = 0; x < size * channels; x++) {
+			c = x / channels;
+			for(b = 0; b < bytes; b++) {
+				row[x*bytes + b] = (unsigned char)(x % channels == 3 ? 255 : c ^ y ^ b);
+			}
+		}
+		png_write_row(png_ptr, row);
+	}
+
+	png_write_end(png_ptr, NULL);
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+	fclose(fp);
+	free(row);
+	return true;
+
+}
+
+// One load of a large atlas: time and growth of peak RSS. Run before the
+// other texture passes so an earlier peak does not hide this one.
+void measure_atlas() {
+
+	double start, ms;
+	struct rusage before, after;
+	GLuint texture_id;
+
+	if(!write_png(ATLAS, ATLAS_SIZE, PNG_COLOR_TYPE_RGBA, 8, false)) {
+		fprintf(stderr, "Could not write %s\n", ATLAS);
+		return;
+	}
+
+	dash_texture_mipmaps(DASH_MIPMAP_NONE);
+	getrusage(RUSAGE_SELF, &before);
+	start = now();
+	texture_id = dash_texture_load(ATLAS);
+	glFinish();
+	ms = (now() - start) / 1e6;
+	getrusage(RUSAGE_SELF, &after);
+	dash_texture_mipmaps(DASH_MIPMAP_GENERATE);
+
+	glDeleteTextures(1, &texture_id);
+	remove(ATLAS);
+
+	printf("dash_texture_load atlas %dx%d: %.1f ms, peak RSS +%.1f MiB (image is %.1f MiB)\n",
+		ATLAS_SIZE, ATLAS_SIZE, ms, (after.ru_maxrss - before.ru_maxrss) / 1024.0,
+		ATLAS_SIZE * ATLAS_SIZE * 4 / 1048576.0);
+
+}
+
+// Texture memory of each PNG color type against expanding it all to RGBA
+void report_formats() {
+
+	int i;
+	size_t before;
+	GLuint texture_id;
+	static const struct {
+		const char *name;
+		int color_type, bit_depth;
+		bool trns;
+	} types[] = {
+		{ "grey 1 bit",       PNG_COLOR_TYPE_GRAY,       1,  false },
+		{ "grey 8 bit",       PNG_COLOR_TYPE_GRAY,       8,  false },
+		{ "grey 16 bit",      PNG_COLOR_TYPE_GRAY,       16, false },
+		{ "grey + tRNS",      PNG_COLOR_TYPE_GRAY,       8,  true },
+		{ "grey + alpha",     PNG_COLOR_TYPE_GRAY_ALPHA, 8,  false },
+		{ "palette",          PNG_COLOR_TYPE_PALETTE,    8,  false },
+		{ "palette + tRNS",   PNG_COLOR_TYPE_PALETTE,    8,  true },
+		{ "rgb 16 bit",       PNG_COLOR_TYPE_RGB,        16, false },
+		{ "rgba 8 bit",       PNG_COLOR_TYPE_RGBA,       8,  false }
+	};
+
+	printf("\n%-28s %12s %12s\n", "texture memory 256x256", "KiB", "as RGBA");
+	dash_texture_mipmaps(DASH_MIPMAP_NONE);
+	for(i = 0; i < (int)(sizeof(types) / sizeof(types[0])); i++) {
+		if(!write_png(ATLAS, 256, types[i].color_type, types[i].bit_depth, types[i].trns)) {
+			fprintf(stderr, "Could not write %s\n", ATLAS);
+			break;
+		}
+		before = dash_texture_memory();
+		texture_id = dash_texture_acquire(ATLAS);
+		printf("%-28s %12.1f %12.1f\n", types[i].name,
+			texture_id ? (dash_texture_memory() - before) / 1024.0 : 0.0, 256 * 256 * 4 / 1024.0);
+		dash_texture_release(texture_id);
+	}
+	dash_texture_mipmaps(DASH_MIPMAP_GENERATE);
+	remove(ATLAS);
+
+}
+
+// Writes back and drops a file from the page cache, so the next read is cold
+void evict(const char *filename) {
+
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if(fd != -1) {
+		fdatasync(fd);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+
+}
+
+double time_load(GLuint (*load)(const char*), const char *filename, bool cold) {
+
+	double start, ms;
+	GLuint texture_id;
+
+	if(cold) {
+		evict(filename);
+	}
+
+	start = now();
+	texture_id = load(filename);
+	glFinish();
+	ms = (now() - start) / 1e6;
+
+	glDeleteTextures(1, &texture_id);
+	return ms;
+
+}
+
+// Startup cost of a PNG against its cooked .dtex, both ending with full mips
+void measure_cooked() {
+
+	int i, j;
+	double warm, ms;
+	struct stat st;
+	const char *files[2];
+	GLuint (*loaders[2])(const char*) = { dash_texture_load, dash_texture_load_cooked };
+	static const char *names[2][2] = {
+		{ "crate png", "crate dtex" },
+		{ "atlas png", "atlas dtex" }
+	};
+
+	if(!write_png(ATLAS, ATLAS_SIZE, PNG_COLOR_TYPE_RGBA, 8, false)) {
+		fprintf(stderr, "Could not write %s\n", ATLAS);
+		return;
+	}
+
+	printf("\n%-28s %12s %12s %12s\n", "startup ms", "cold", "warm", "file KiB");
+	for(i = 0; i < 2; i++) {
+		files[0] = i == 0 ? TEXTURE : ATLAS;
+		files[1] = COOKED;
+		if(!dash_texture_cook(files[0], COOKED)) {
+			break;
+		}
+
+		// An untimed load first, so driver setup does not count as cold
+		for(j = 0; j < 2; j++) {
+			time_load(loaders[j], files[j], false);
+			ms = time_load(loaders[j], files[j], true);
+			warm = time_load(loaders[j], files[j], false);
+			warm = fmin(warm, time_load(loaders[j], files[j], false));
+			warm = fmin(warm, time_load(loaders[j], files[j], false));
+			stat(files[j], &st);
+			printf("%-28s %12.2f %12.2f %12.1f\n", names[i][j], ms, warm, st.st_size / 1024.0);
+		}
+	}
+
+	remove(COOKED);
+	remove(ATLAS);
+
+}
+
+bool needs_gl(benchmark *b) {
+
+	return b->pass == pass_texture_load || b->pass == pass_texture_load_flat ||
+		b->pass == pass_texture_load_cpu || b->pass == pass_texture_acquire;
+
+}
+
+void pass_downsample() {
+
+	dash_image_downsample(image, IMAGE, IMAGE, 4, image_half);
+
+}
+
+void pass_image_transform() {
+
+	dash_image_transform(image, IMAGE, IMAGE, 4, DASH_IMAGE_PREMULTIPLY | DASH_IMAGE_SWAP_RB);
+
+}
+
+void pass_texture_load_flat() {
+
+	dash_texture_mipmaps(DASH_MIPMAP_NONE);
+	pass_texture_load();
+	dash_texture_mipmaps(DASH_MIPMAP_GENERATE);
+
+}
+
+void pass_texture_load_cpu() {
+
+	dash_texture_mipmaps(DASH_MIPMAP_CPU);
+	pass_texture_load();
+	dash_texture_mipmaps(DASH_MIPMAP_GENERATE);
+
+}
+
+// One reference is held for the whole run, so every acquire is a hit
+void pass_texture_acquire() {
+
+	static GLuint held;
+
+	if(held == 0) {
+		held = dash_texture_acquire(TEXTURE);
+	}
+	dash_texture_release(dash_texture_acquire(TEXTURE));
+
+}
+
+void pass_texture_load() {
+
+	GLuint texture_id;
+
+	texture_id = dash_texture_load(TEXTURE);
+	glDeleteTextures(1, &texture_id);
+
+}
+
+void pass_transform_all() {
+
+	int i;
+
+	for(i = 0; i < COUNT; i++) {
+		transform_set_rotation(&tree, i, qa[i]);
+	}
+	transform_update(&tree);
+
+}
+
+void pass_transform_sparse() {
+
+	int i;
+
+	for(i = 0; i < COUNT / 100 && i < leaf_count; i++) {
+		transform_set_rotation(&tree, leaves[i * leaf_count / (COUNT / 100)], qa[i]);
+	}
+	transform_update(&tree);
+
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <string.h>
+#include <GL/glew.h>
+#include "SDL.h"
+#include "lib/dashgl.h"
+
+// Cooks PNG files into .dtex files for dash_texture_load_cooked. A hidden
+// window provides the context that picks the texture formats, so run it on
+// the kind of machine the files are for.
+//
+// cook [--flip] [--premultiply] [--swap-rb] input.png [output.dtex]
+//
+// The output defaults to the input with its extension replaced by .dtex.
+
+int main(int argc, char *argv[]) {
+
+	int i, flags = 0;
+	const char *input = NULL, *output = NULL;
+	char path[1024];
+	char *dot;
+
+	for(i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--flip") == 0) {
+			flags |= DASH_IMAGE_FLIP_Y;
+		} else if(strcmp(argv[i], "--premultiply") == 0) {
+			flags |= DASH_IMAGE_PREMULTIPLY;
+		} else if(strcmp(argv[i], "--swap-rb") == 0) {
+			flags |= DASH_IMAGE_SWAP_RB;
+		} else if(input == NULL) {
+			input = argv[i];
+		} else if(output == NULL) {
+			output = argv[i];
+		} else {
+			input = NULL;
+			break;
+		}
+	}
+
+	if(input == NULL) {
+		fprintf(stderr, "usage: %s [--flip] [--premultiply] [--swap-rb] input.png [output.dtex]\n", argv[0]);
+		return 1;
+	}
+
+	if(output == NULL) {
+		snprintf(path, sizeof(path) - 5, "%s", input);
+		dot = strrchr(path, '.');
+		if(dot != NULL && strchr(dot, '/') == NULL) {
+			*dot = '\0';
+		}
+		strcat(path, ".dtex");
+		output = path;
+	}
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window *window = SDL_CreateWindow(
+		"cook",
+		SDL_WINDOWPOS_CENTERED,
+		SDL_WINDOWPOS_CENTERED,
+		64,
+		64,
+		SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL
+	);
+
+	if(window == NULL) {
+		fprintf(stderr, "Error can't create window %s\n", SDL_GetError());
+		return 1;
+	}
+
+	if(SDL_GL_CreateContext(window) == NULL) {
+		fprintf(stderr, "Error can't create context %s\n", SDL_GetError());
+		return 1;
+	}
+
+	GLenum glew_status = glewInit();
+	if(glew_status != GLEW_OK) {
+		fprintf(stderr, "Error glewInit: %s\n", glewGetErrorString(glew_status));
+		return 1;
+	}
+
+	dash_texture_transform(flags);
+	if(!dash_texture_cook(input, output)) {
+		return 1;
+	}
+
+	printf("%s -> %s\n", input, output);
+	return 0;
+
+}
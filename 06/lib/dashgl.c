@@ -24,9 +24,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#endif
 #include <GL/glew.h>
 #include "dashgl.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DASH_X86
+#define DASH_TARGET(x) __attribute__((target(x)))
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 /******************************************************************************/
 /** Vector3 Utils                                                            **/
 /******************************************************************************/
@@ -105,42 +125,61 @@ void dash_print_log(GLuint object) {
 
 }
 
-GLuint dash_create_shader(const char *filename, GLenum type) {
+#ifdef GL_ES_VERSION_2_0
+static const char shader_version[] = "#version 100\n"; // OpenGL ES 2.0
+#else
+static const char shader_version[] = "#version 120\n"; // OpenGL 2.1
+#endif
+
+static char *program_cache_dir;
+static program_cache_stats cache_stats;
+
+static double now_ms() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+
+}
+
+static char *read_source(const char *filename) {
 
 	FILE *fp;
-	int file_len;
+	long file_len;
 	char *source;
 
 	fp = fopen(filename, "rb");
 	if(!fp) {
 		fprintf(stderr, "Could not open %s for reading\n", filename);
-		return 0;
+		return NULL;
 	}
-	
+
 	fseek(fp, 0, SEEK_END);
 	file_len = ftell(fp);
 	fseek(fp, 0, SEEK_SET);
 
 	source = (char*)malloc(file_len + 1);
-	fread(source, file_len, 1, fp);
+	if(source == NULL || fread(source, 1, file_len, fp) != (size_t)file_len) {
+		fprintf(stderr, "Could not read %s\n", filename);
+		free(source);
+		fclose(fp);
+		return NULL;
+	}
+
 	fclose(fp);
 	source[file_len] = '\0';
+	return source;
+
+}
 
-	const GLchar *sources[] = {
-		#ifdef GL_ES_VERSION_2_0
-		"#version 100\n", //OpenGL ES 2.0
-		#else
-		"#version 120\n", // OpenGL 2.1
-		#endif
-		source
-	};
+static GLuint compile_shader(const char *filename, const char *source, GLenum type) {
+
+	const GLchar *sources[] = { shader_version, source };
 
 	GLuint shader = glCreateShader(type);
 	glShaderSource(shader, 2, sources, NULL);
 	glCompileShader(shader);
 
-	free((void*)source);
-
 	GLint compile_ok;
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_ok);
 	if(compile_ok == GL_FALSE) {
@@ -154,446 +193,6182 @@ GLuint dash_create_shader(const char *filename, GLenum type) {
 
 }
 
-GLuint dash_create_program(const char *vertex, const char *fragment) {
+/*
+ * Program binary cache. Linked programs are saved with glGetProgramBinary
+ * under a 64-bit FNV-1a hash of everything that can change the binary: the
+ * version line, both sources and the vendor, renderer and driver version
+ * strings. Each file starts with a small header so truncated or foreign
+ * files are ignored, and a binary the driver rejects is deleted and rebuilt.
+ */
 
-	GLuint vs = dash_create_shader(vertex, GL_VERTEX_SHADER);
-	GLuint fs = dash_create_shader(fragment, GL_FRAGMENT_SHADER);
-	if(vs == 0 || fs == 0) {
-		return 0;
-	}
-	
-	GLint link_ok;
-	
-	GLuint program = glCreateProgram();
-	glAttachShader(program, vs);
-	glAttachShader(program, fs);
-	glLinkProgram(program);
-	glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
-	if(!link_ok) {
-		fprintf(stderr, "Program Link Error: ");
-		dash_print_log(program);
+#define PROGRAM_CACHE_MAGIC 0x42474c44
+
+typedef struct {
+	unsigned int magic;
+	unsigned int format;
+	unsigned int length;
+	unsigned int reserved;
+	unsigned long long key;
+} program_cache_header;
+
+static unsigned long long hash_string(unsigned long long h, const char *str) {
+
+	// The terminator is hashed too so "ab" + "c" differs from "a" + "bc"
+	do {
+		h ^= (unsigned char)*str;
+		h *= 1099511628211ULL;
+	} while(*str++);
+
+	return h;
+
+}
+
+static unsigned long long program_key(const char *vertex, const char *fragment) {
+
+	unsigned long long h = 14695981039346656037ULL;
+
+	h = hash_string(h, shader_version);
+	h = hash_string(h, vertex);
+	h = hash_string(h, fragment);
+	h = hash_string(h, (const char*)glGetString(GL_VENDOR));
+	h = hash_string(h, (const char*)glGetString(GL_RENDERER));
+	h = hash_string(h, (const char*)glGetString(GL_VERSION));
+
+	return h;
+
+}
+
+static int program_binary_supported() {
+
+	GLint formats = 0;
+
+	if(!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
 		return 0;
 	}
-	
-	return program;
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
 
 }
 
+static void program_cache_path(unsigned long long key, char *path, size_t size) {
 
+	snprintf(path, size, "%s/%016llx.glbin", program_cache_dir, key);
 
+}
 
-GLuint dash_texture_load(const char *filename) {
+static GLuint program_cache_load(unsigned long long key) {
 
 	FILE *fp;
-	
-	GLuint texture_id;
-	png_structp png_ptr;
-    png_infop info_ptr;
-	int width, height, bit_depth;
-	unsigned char *data;
-	int color_type, num_passes, y, x, i;
-	char header[8];
-	png_bytep *rows;
+	char path[1024];
+	void *binary;
+	program_cache_header header;
+	GLuint program;
+	GLint link_ok;
 
-	fp = fopen(filename, "rb");
+	program_cache_path(key, path, sizeof(path));
+	fp = fopen(path, "rb");
 	if(fp == NULL) {
-		fprintf(stderr, "Could not open %s for reading\n", filename);
-		exit(1);
+		return 0;
 	}
 
-	if(fread(header, 1, 8, fp) <= 0) {
-		fprintf(stderr, "Could not read png header\n");
-		exit(1);
+	if(fread(&header, sizeof(header), 1, fp) != 1 ||
+		header.magic != PROGRAM_CACHE_MAGIC || header.key != key) {
+		fclose(fp);
+		return 0;
 	}
 
-	if (png_sig_cmp(header, 0, 8)) {
-		fprintf(stderr, "%s is not a valid png file\n", filename);
-		exit(1);
+	binary = malloc(header.length);
+	if(binary == NULL || fread(binary, 1, header.length, fp) != header.length) {
+		free(binary);
+		fclose(fp);
+		return 0;
+	}
+	fclose(fp);
+
+	program = glCreateProgram();
+	glProgramBinary(program, header.format, binary, header.length);
+	free(binary);
 
+	glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
+	if(!link_ok) {
+		// Usually a driver update; drop the file so the rebuild replaces it
+		glDeleteProgram(program);
+		remove(path);
+		cache_stats.rejected++;
+		return 0;
 	}
 
-	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	return program;
 
-    if (png_ptr == NULL) {
-        fclose(fp);
-        return 0;
-    }
-
-    info_ptr = png_create_info_struct(png_ptr);
-    if (info_ptr == NULL) {
-        fclose(fp);
-        png_destroy_read_struct(&png_ptr, NULL, NULL);
-        return 0;
-    }
-
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-        fclose(fp);
-        return 0;
-    }
-
-    png_init_io(png_ptr, fp);
-	png_set_sig_bytes(png_ptr, 8);
-	png_read_info(png_ptr, info_ptr);
+}
 
-	width = png_get_image_width(png_ptr, info_ptr);
-	height = png_get_image_height(png_ptr, info_ptr);
-	
-	color_type = png_get_color_type(png_ptr, info_ptr);
-	bit_depth  = png_get_bit_depth(png_ptr, info_ptr);
+static void program_cache_store(unsigned long long key, GLuint program) {
 
-	num_passes = png_set_interlace_handling(png_ptr);
-	png_read_update_info(png_ptr, info_ptr);
+	FILE *fp;
+	char path[1024], tmp[1040];
+	void *binary;
+	GLint length = 0;
+	GLenum format;
+	program_cache_header header;
 
-	switch(color_type) {
-		case 0:
-			printf("grayscale\n");
-			exit(1);
-		break;
-		case PNG_COLOR_TYPE_RGB:
-			bit_depth = GL_RGB;
-			color_type = 3;
-			data = (unsigned char*)malloc(3 * width * height);
-		break;
-		case 3:
-			printf("pallete look up table\n");
-			exit(1);
-		break;
-		case 4:
-			printf("grayscale with alpha\n");
-			exit(1);
-		break;
-		case PNG_COLOR_TYPE_RGBA:
-			bit_depth = GL_RGBA;
-			color_type = 4;
-			printf("RGBA\n");
-			data = (unsigned char*)malloc(4 * width * height);
-		break;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0) {
+		return;
 	}
 
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-        fclose(fp);
-        return 0;
-    }
-	
-	rows = (png_bytep*) malloc(sizeof(png_bytep) * height);
-	for (y = 0; y < height; y++) {
-		rows[y] = (png_byte*) malloc(png_get_rowbytes(png_ptr, info_ptr));
+	binary = malloc(length);
+	if(binary == NULL) {
+		return;
 	}
-	
-	png_read_image(png_ptr, rows);
-	fclose(fp);
 
-	i = 0;
-	for(y = 0; y < height; y++) {
-		memcpy((void*)&data[y*width*color_type], (void*)rows[y], width * color_type);
-		png_free(png_ptr, rows[y]);
+	glGetProgramBinary(program, length, &length, &format, binary);
+
+	memset(&header, 0, sizeof(header));
+	header.magic = PROGRAM_CACHE_MAGIC;
+	header.format = format;
+	header.length = length;
+	header.key = key;
+
+	// Write beside the final name and rename, so readers never see half a file
+	program_cache_path(key, path, sizeof(path));
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	fp = fopen(tmp, "wb");
+	if(fp == NULL) {
+		free(binary);
+		return;
 	}
-	
-	png_free(png_ptr, rows);
-	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 
-    glGenTextures(1, &texture_id);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D,
-        0,
-        bit_depth,
-        width,
-        height,
-        0,
-        bit_depth,
-        GL_UNSIGNED_BYTE,
-        data
-    );
-	free(data);
+	if(fwrite(&header, sizeof(header), 1, fp) == 1 &&
+		fwrite(binary, 1, length, fp) == (size_t)length && fclose(fp) == 0) {
+		rename(tmp, path);
+	} else {
+		remove(tmp);
+	}
 
-	return texture_id;
+	free(binary);
 
 }
 
-/******************************************************************************/
-/** Matrix Utils                                                             **/
-/******************************************************************************/
+/*
+ * Enables the program binary cache in directory, creating it if needed.
+ * NULL disables it. Only used when the context supports program binaries.
+ */
 
+void dash_program_cache(const char *directory) {
 
-void mat4_identity(mat4 m) {
-	
-	m[M_00] = 1.0f;
-	m[M_01] = 0.0f;
-	m[M_02] = 0.0f;
-	m[M_03] = 0.0f;
-	m[M_10] = 0.0f;
-	m[M_11] = 1.0f;
-	m[M_12] = 0.0f;
-	m[M_13] = 0.0f;
-	m[M_20] = 0.0f;
-	m[M_21] = 0.0f;
-	m[M_22] = 1.0f;
-	m[M_23] = 0.0f;
-	m[M_30] = 0.0f;
-	m[M_31] = 0.0f;
-	m[M_32] = 0.0f;
-	m[M_33] = 1.0f;
+	free(program_cache_dir);
+	program_cache_dir = NULL;
 
-}
+	if(directory == NULL) {
+		return;
+	}
 
-void mat4_copy(mat4 a, mat4 m) {
-	
-	m[M_00] = a[M_00];
-	m[M_01] = a[M_01];
-	m[M_02] = a[M_02];
-	m[M_03] = a[M_03];
-	m[M_10] = a[M_10];
-	m[M_11] = a[M_11];
-	m[M_12] = a[M_12];
-	m[M_13] = a[M_13];
-	m[M_20] = a[M_20];
-	m[M_21] = a[M_21];
-	m[M_22] = a[M_22];
-	m[M_23] = a[M_23];
-	m[M_30] = a[M_30];
-	m[M_31] = a[M_31];
-	m[M_32] = a[M_32];
-	m[M_33] = a[M_33];
+	if(mkdir(directory, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Could not create program cache %s\n", directory);
+		return;
+	}
+
+	program_cache_dir = strdup(directory);
 
 }
 
-void mat4_translate(vec3 t, mat4 m) {
+void dash_program_cache_stats(program_cache_stats *stats) {
 
-	m[M_00] = 1.0f;
-	m[M_10] = 0.0f;
-	m[M_20] = 0.0f;
-	m[M_30] = 0.0f;
-	
-	m[M_01] = 0.0f;
-	m[M_11] = 1.0f;
-	m[M_21] = 0.0f;
-	m[M_31] = 0.0f;
-	
-	m[M_02] = 0.0f;
-	m[M_12] = 0.0f;
-	m[M_22] = 1.0f;
-	m[M_32] = 0.0f;
-	
-	m[M_03] = t[0];
-	m[M_13] = t[1];
-	m[M_23] = t[2];
-	m[M_33] = 1.0f;
+	*stats = cache_stats;
 
 }
 
-void mat4_rotate_x(float x, mat4 m) {
+/*
+ * Shader preprocessor. Lines of the form #include "file" are replaced by that
+ * file, resolved relative to the including file, and each entry of a NULL
+ * terminated defines list ("NAME" or "NAME value") becomes a #define after
+ * the version line. The result is hashed with the shader type and compiled
+ * at most once per process; programs that share a variant share the shader
+ * object. Each program built from a variant holds a reference to it. Hot
+ * reload gives its references back when a program is replaced or rejected,
+ * so edits do not pile up variants; the rest stay owned by the variant
+ * table until dash_shader_cache_clear.
+ */
 
-	m[M_00] = 1.0f;
-	m[M_01] = 0.0f;
-	m[M_02] = 0.0f;
-	m[M_03] = 0.0f;
-	m[M_10] = 0.0f;
-	m[M_11] = cos(x);
-	m[M_12] =-sin(x);
-	m[M_13] = 0.0f;
-	m[M_20] = 0.0f;
-	m[M_21] = sin(x);
-	m[M_22] = cos(x);
-	m[M_23] = 0.0f;
-	m[M_30] = 0.0f;
-	m[M_31] = 0.0f;
-	m[M_32] = 0.0f;
-	m[M_33] = 1.0f;
+#define INCLUDE_DEPTH 16
 
-}
+typedef struct {
+	char *data;
+	size_t length;
+	size_t capacity;
+} text_buffer;
 
-void mat4_rotate_y(float y, mat4 m) {
+typedef struct {
+	unsigned long long key;
+	GLuint shader;
+	int refs;
+} shader_variant;
 
-	m[M_00] = cos(y);
-	m[M_01] = 0.0f;
-	m[M_02] = sin(y);
-	m[M_03] = 0.0f;
-	m[M_10] = 0.0f;
-	m[M_11] = 1.0f;
-	m[M_12] = 0.0f;
-	m[M_13] = 0.0f;
-	m[M_20] =-sin(y);
-	m[M_21] = 0.0f;
-	m[M_22] = cos(y);
-	m[M_23] = 0.0f;
-	m[M_30] = 0.0f;
-	m[M_31] = 0.0f;
-	m[M_32] = 0.0f;
-	m[M_33] = 1.0f;
+static shader_variant *variants;
+static int variant_count, variant_capacity;
+
+static int text_append(text_buffer *t, const char *str, size_t len) {
+
+	char *data;
+	size_t capacity;
+
+	if(t->length + len + 1 > t->capacity) {
+		capacity = t->capacity ? t->capacity : 1024;
+		while(t->length + len + 1 > capacity) {
+			capacity *= 2;
+		}
+		data = (char*)realloc(t->data, capacity);
+		if(data == NULL) {
+			return 0;
+		}
+		t->data = data;
+		t->capacity = capacity;
+	}
+
+	memcpy(t->data + t->length, str, len);
+	t->length += len;
+	t->data[t->length] = '\0';
+	return 1;
 
 }
 
-void mat4_rotate_z(float z, mat4 m) {
+static int strstr_n(const char *haystack, const char *needle, size_t len) {
 
-	m[M_00] = cos(z);
-	m[M_01] =-sin(z);
-	m[M_02] = 0.0f;
-	m[M_03] = 0.0f;
-	m[M_10] = sin(z);
-	m[M_11] = cos(z);
-	m[M_12] = 0.0f;
-	m[M_13] = 0.0f;
-	m[M_20] = 0.0f;
-	m[M_21] = 0.0f;
-	m[M_22] = 1.0f;
-	m[M_23] = 0.0f;
-	m[M_30] = 0.0f;
-	m[M_31] = 0.0f;
-	m[M_32] = 0.0f;
-	m[M_33] = 1.0f;
+	for(; *haystack; haystack++) {
+		if(!strncmp(haystack, needle, len)) {
+			return 1;
+		}
+	}
+
+	return 0;
 
 }
 
+static int preprocess(const char *filename, int depth, text_buffer *out) {
 
-void mat4_multiply(mat4 a, mat4 b, mat4 m) {
+	char *source, *line, *end, *name, *close_quote;
+	const char *slash;
+	char path[1024];
+	int ok = 1;
 
-	mat4 tmp;
+	if(depth > INCLUDE_DEPTH) {
+		fprintf(stderr, "%s: #include nested too deeply\n", filename);
+		return 0;
+	}
 
-	tmp[M_00] = a[M_00]*b[M_00]+a[M_01]*b[M_10]+a[M_02]*b[M_20]+a[M_03]*b[M_30];
-	tmp[M_01] = a[M_00]*b[M_01]+a[M_01]*b[M_11]+a[M_02]*b[M_21]+a[M_03]*b[M_31];
-	tmp[M_02] = a[M_00]*b[M_02]+a[M_01]*b[M_12]+a[M_02]*b[M_22]+a[M_03]*b[M_32];
-	tmp[M_03] = a[M_00]*b[M_03]+a[M_01]*b[M_13]+a[M_02]*b[M_23]+a[M_03]*b[M_33];
-   
-	tmp[M_10] = a[M_10]*b[M_00]+a[M_11]*b[M_10]+a[M_12]*b[M_20]+a[M_13]*b[M_30];
-	tmp[M_11] = a[M_10]*b[M_01]+a[M_11]*b[M_11]+a[M_12]*b[M_21]+a[M_13]*b[M_31];
-	tmp[M_12] = a[M_10]*b[M_02]+a[M_11]*b[M_12]+a[M_12]*b[M_22]+a[M_13]*b[M_32];
-	tmp[M_13] = a[M_10]*b[M_03]+a[M_11]*b[M_13]+a[M_12]*b[M_23]+a[M_13]*b[M_33];
- 
-	tmp[M_20] = a[M_20]*b[M_00]+a[M_21]*b[M_10]+a[M_22]*b[M_20]+a[M_23]*b[M_30];
-	tmp[M_21] = a[M_20]*b[M_01]+a[M_21]*b[M_11]+a[M_22]*b[M_21]+a[M_23]*b[M_31];
-	tmp[M_22] = a[M_20]*b[M_02]+a[M_21]*b[M_12]+a[M_22]*b[M_22]+a[M_23]*b[M_32];
-	tmp[M_23] = a[M_20]*b[M_03]+a[M_21]*b[M_13]+a[M_22]*b[M_23]+a[M_23]*b[M_33];
- 
-	tmp[M_30] = a[M_30]*b[M_00]+a[M_31]*b[M_10]+a[M_32]*b[M_20]+a[M_33]*b[M_30];
-	tmp[M_31] = a[M_30]*b[M_01]+a[M_31]*b[M_11]+a[M_32]*b[M_21]+a[M_33]*b[M_31];
-	tmp[M_32] = a[M_30]*b[M_02]+a[M_31]*b[M_12]+a[M_32]*b[M_22]+a[M_33]*b[M_32];
-	tmp[M_33] = a[M_30]*b[M_03]+a[M_31]*b[M_13]+a[M_32]*b[M_23]+a[M_33]*b[M_33];
+	source = read_source(filename);
+	if(source == NULL) {
+		return 0;
+	}
 
-	mat4_copy(tmp, m);
+	for(line = source; ok && *line; line = end) {
+		end = strchr(line, '\n');
+		end = end ? end + 1 : line + strlen(line);
 
-}
+		name = line + strspn(line, " \t");
+		if(strncmp(name, "#include", 8) != 0) {
+			ok = text_append(out, line, end - line);
+			continue;
+		}
 
-void mat4_rotate(vec3 r, mat4 m) {
+		name = strchr(name, '"');
+		close_quote = name ? strchr(name + 1, '"') : NULL;
+		if(close_quote == NULL || close_quote > end) {
+			fprintf(stderr, "%s: malformed #include\n", filename);
+			ok = 0;
+			break;
+		}
 
-	mat4 rot_x, rot_y, rot_z;
-	mat4_rotate_x(r[0], rot_x);
-	mat4_rotate_y(r[1], rot_y);
-	mat4_rotate_z(r[2], rot_z);
+		slash = strrchr(filename, '/');
+		snprintf(
+			path,
+			sizeof(path),
+			"%.*s%.*s",
+			slash ? (int)(slash - filename + 1) : 0,
+			filename,
+			(int)(close_quote - name - 1),
+			name + 1
+		);
+		ok = preprocess(path, depth + 1, out);
+	}
 
-	mat4_multiply(rot_x, rot_y, m);
-	mat4_multiply(m, rot_z, m);
+	free(source);
+	return ok;
 
 }
 
+static char *shader_source(const char *filename, const char **defines) {
 
-void mat4_look_at(vec3 eye, vec3 center, vec3 up, mat4 m) {
-	
-	mat4 a;
-	vec3 f, s, t;
-	
-	vec3_subtract(center, eye, f);
-	vec3_normalize(f, f);
+	text_buffer body = { NULL, 0, 0 };
+	text_buffer out = { NULL, 0, 0 };
+	size_t name_len;
+	int ok = 1;
 
-	vec3_cross_multiply(f, up, s);
-	vec3_normalize(s, s);
+	if(!preprocess(filename, 0, &body)) {
+		free(body.data);
+		return NULL;
+	}
 
-	vec3_cross_multiply(s, f, t);
+	// Defines the source never mentions are dropped so they do not split
+	// otherwise identical variants, e.g. a vertex-only feature in a fragment
+	for(; ok && defines && *defines; defines++) {
+		name_len = strcspn(*defines, " \t");
+		if(!strstr_n(body.data, *defines, name_len)) {
+			continue;
+		}
+		ok = text_append(&out, "#define ", 8) &&
+			text_append(&out, *defines, strlen(*defines)) &&
+			text_append(&out, "\n", 1);
+	}
+
+	ok = ok && text_append(&out, body.data, body.length);
+	free(body.data);
+
+	if(!ok) {
+		free(out.data);
+		return NULL;
+	}
+
+	return out.data;
+
+}
+
+// Compiles without checking status so variants can build in parallel
+static GLuint shader_variant_get(const char *source, GLenum type) {
+
+	int i;
+	unsigned long long key;
+	shader_variant *grown;
+	const GLchar *sources[] = { shader_version, source };
+
+	key = hash_string(hash_string(14695981039346656037ULL, shader_version), source);
+	key = (key ^ type) * 1099511628211ULL;
+
+	// Programs use a handful of variants, a linear scan is enough
+	for(i = 0; i < variant_count; i++) {
+		if(variants[i].key == key) {
+			variants[i].refs++;
+			return variants[i].shader;
+		}
+	}
+
+	if(variant_count == variant_capacity) {
+		variant_capacity = variant_capacity ? variant_capacity * 2 : 16;
+		grown = (shader_variant*)realloc(variants, sizeof(shader_variant) * variant_capacity);
+		if(grown == NULL) {
+			variant_capacity = variant_count;
+			return 0;
+		}
+		variants = grown;
+	}
+
+	variants[variant_count].key = key;
+	variants[variant_count].refs = 1;
+	variants[variant_count].shader = glCreateShader(type);
+	glShaderSource(variants[variant_count].shader, 2, sources, NULL);
+	glCompileShader(variants[variant_count].shader);
+
+	return variants[variant_count++].shader;
+
+}
+
+// Drops one reference; the last deletes the shader, linked programs keep theirs
+static void shader_variant_release(GLuint shader) {
+
+	int i;
+
+	for(i = 0; i < variant_count; i++) {
+		if(variants[i].shader == shader) {
+			if(--variants[i].refs <= 0) {
+				glDeleteShader(shader);
+				variants[i] = variants[--variant_count];
+			}
+			return;
+		}
+	}
+
+}
+
+void dash_shader_cache_clear() {
+
+	int i;
+
+	for(i = 0; i < variant_count; i++) {
+		glDeleteShader(variants[i].shader);
+	}
+
+	free(variants);
+	variants = NULL;
+	variant_count = 0;
+	variant_capacity = 0;
+
+}
+
+GLuint dash_create_shader(const char *filename, GLenum type) {
+
+	char *source;
+	GLuint shader;
+
+	source = shader_source(filename, NULL);
+	if(source == NULL) {
+		return 0;
+	}
+
+	shader = compile_shader(filename, source, type);
+	free(source);
+
+	return shader;
+
+}
+
+/*
+ * Asynchronous program creation. dash_program_submit compiles and links
+ * without asking for any status, so several programs can be queued before
+ * the driver is made to wait. With KHR_parallel_shader_compile the driver
+ * builds them on its own threads and dash_program_poll only reports ready
+ * once GL_COMPLETION_STATUS_KHR is set; without it, poll blocks on the first
+ * status query just as dash_create_program always did.
+ */
+
+static int parallel_compile() {
+
+	static int threads_set;
+
+	if(!GLEW_KHR_parallel_shader_compile) {
+		return 0;
+	}
+
+	if(!threads_set) {
+		// Let the driver pick as many compiler threads as it wants
+		glMaxShaderCompilerThreadsKHR(0xffffffff);
+		threads_set = 1;
+	}
+
+	return 1;
+
+}
+
+int dash_program_submit(const char *vertex, const char *fragment, const char **defines, program_request *req) {
+
+	char *vs_source, *fs_source;
+
+	memset(req, 0, sizeof(program_request));
+	req->vertex_name = vertex;
+	req->fragment_name = fragment;
+	req->start = now_ms();
+	req->state = DASH_PROGRAM_FAILED;
+
+	vs_source = shader_source(vertex, defines);
+	fs_source = shader_source(fragment, defines);
+	if(vs_source == NULL || fs_source == NULL) {
+		free(vs_source);
+		free(fs_source);
+		return 0;
+	}
+
+	req->cached = program_cache_dir != NULL && program_binary_supported();
+	if(req->cached) {
+		req->key = program_key(vs_source, fs_source);
+		req->program = program_cache_load(req->key);
+		if(req->program != 0) {
+			free(vs_source);
+			free(fs_source);
+			cache_stats.hits++;
+			cache_stats.hit_ms += now_ms() - req->start;
+			req->state = DASH_PROGRAM_READY;
+			return 1;
+		}
+	}
+
+	parallel_compile();
+
+	req->vertex = shader_variant_get(vs_source, GL_VERTEX_SHADER);
+	req->fragment = shader_variant_get(fs_source, GL_FRAGMENT_SHADER);
+	free(vs_source);
+	free(fs_source);
+
+	if(req->vertex == 0 || req->fragment == 0) {
+		shader_variant_release(req->vertex);
+		shader_variant_release(req->fragment);
+		return 0;
+	}
+
+	req->program = glCreateProgram();
+	glAttachShader(req->program, req->vertex);
+	glAttachShader(req->program, req->fragment);
+	if(req->cached) {
+		glProgramParameteri(req->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(req->program);
+
+	req->state = DASH_PROGRAM_PENDING;
+	return 1;
+
+}
+
+static void program_request_finish(program_request *req) {
+
+	GLint compile_ok, link_ok;
+
+	glGetProgramiv(req->program, GL_LINK_STATUS, &link_ok);
+
+	if(!link_ok) {
+		glGetShaderiv(req->vertex, GL_COMPILE_STATUS, &compile_ok);
+		if(compile_ok == GL_FALSE) {
+			fprintf(stderr, "%s: ", req->vertex_name);
+			dash_print_log(req->vertex);
+		}
+		glGetShaderiv(req->fragment, GL_COMPILE_STATUS, &compile_ok);
+		if(compile_ok == GL_FALSE) {
+			fprintf(stderr, "%s: ", req->fragment_name);
+			dash_print_log(req->fragment);
+		}
+		fprintf(stderr, "Program Link Error: ");
+		dash_print_log(req->program);
+	}
+
+	// The program keeps what it needs; the variants stay for other programs,
+	// and req keeps their names so the references can be given back
+	glDetachShader(req->program, req->vertex);
+	glDetachShader(req->program, req->fragment);
+
+	if(!link_ok) {
+		glDeleteProgram(req->program);
+		req->program = 0;
+		req->state = DASH_PROGRAM_FAILED;
+		return;
+	}
+
+	if(req->cached) {
+		program_cache_store(req->key, req->program);
+	}
+
+	cache_stats.misses++;
+	cache_stats.miss_ms += now_ms() - req->start;
+	req->state = DASH_PROGRAM_READY;
+
+}
+
+int dash_program_poll(program_request *req) {
+
+	GLint done;
+
+	if(req->state != DASH_PROGRAM_PENDING) {
+		return req->state;
+	}
+
+	if(parallel_compile()) {
+		glGetProgramiv(req->program, GL_COMPLETION_STATUS_KHR, &done);
+		if(!done) {
+			return DASH_PROGRAM_PENDING;
+		}
+	}
+
+	program_request_finish(req);
+	return req->state;
+
+}
+
+GLuint dash_program_wait(program_request *req) {
+
+	if(req->state == DASH_PROGRAM_PENDING) {
+		program_request_finish(req);
+	}
+
+	return req->program;
+
+}
+
+GLuint dash_create_program(const char *vertex, const char *fragment) {
+
+	return dash_create_program_variant(vertex, fragment, NULL);
+
+}
+
+GLuint dash_create_program_variant(const char *vertex, const char *fragment, const char **defines) {
+
+	program_request req;
+
+	if(!dash_program_submit(vertex, fragment, defines, &req)) {
+		return 0;
+	}
+
+	return dash_program_wait(&req);
+
+}
+
+/*
+ * Shader hot reload. The directories holding both shaders are watched with a
+ * non-blocking inotify descriptor, so checking for edits each frame is one
+ * read() that normally returns EAGAIN. A change submits a new program through
+ * dash_program_submit and later frames poll it. Once the new program links,
+ * dash_shader_reload returns 1 with it in candidate, and the caller checks
+ * it has what the caller needs before dash_shader_accept swaps it in or
+ * throws it away; a failed build leaves the old program in use. Saves that
+ * arrive during a build queue exactly one rebuild.
+ */
+
+#ifdef __linux__
+
+static void watch_parent(int fd, const char *filename) {
+
+	char dir[1024];
+	const char *slash = strrchr(filename, '/');
+
+	if(slash == NULL) {
+		strcpy(dir, ".");
+	} else {
+		snprintf(dir, sizeof(dir), "%.*s", (int)(slash - filename), filename);
+	}
+
+	// Editors often save by renaming a new file over the old one
+	if(inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+		fprintf(stderr, "Could not watch %s\n", dir);
+	}
+
+}
+
+int dash_shader_watch(const char *vertex, const char *fragment, const char **defines, GLuint program, shader_reload *r) {
+
+	memset(r, 0, sizeof(shader_reload));
+	r->vertex = vertex;
+	r->defines = defines;
+	r->fragment = fragment;
+	r->program = program;
+
+	r->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(r->fd == -1) {
+		fprintf(stderr, "Could not start shader watcher\n");
+		return 0;
+	}
+
+	watch_parent(r->fd, vertex);
+	watch_parent(r->fd, fragment);
+
+	return 1;
+
+}
+
+static void shader_watch_drain(shader_reload *r) {
+
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	ssize_t len;
+	char *ptr;
+
+	while((len = read(r->fd, buffer, sizeof(buffer))) > 0) {
+		for(ptr = buffer; ptr < buffer + len; ptr += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event*)ptr;
+			if(ev->len == 0) {
+				continue;
+			}
+			// Any shader counts, it may be included; unchanged variants are reused
+			if(strstr(ev->name, ".glsl") != NULL) {
+				r->changed = 1;
+			}
+		}
+	}
+
+}
+
+int dash_shader_reload(shader_reload *r) {
+
+	int state;
+
+	if(r->fd < 0 || r->candidate != 0) {
+		return 0;
+	}
+
+	shader_watch_drain(r);
+
+	if(!r->building) {
+		if(!r->changed) {
+			return 0;
+		}
+		r->changed = 0;
+		if(!dash_program_submit(r->vertex, r->fragment, r->defines, &r->request)) {
+			return 0;
+		}
+		r->building = 1;
+	}
+
+	state = dash_program_poll(&r->request);
+	if(state == DASH_PROGRAM_PENDING) {
+		return 0;
+	}
+
+	r->building = 0;
+	if(state == DASH_PROGRAM_FAILED) {
+		fprintf(stderr, "Shader reload failed, keeping the previous program\n");
+		shader_variant_release(r->request.vertex);
+		shader_variant_release(r->request.fragment);
+		return 0;
+	}
+
+	r->candidate = r->request.program;
+	return 1;
+
+}
+
+void dash_shader_unwatch(shader_reload *r) {
+
+	if(r->building) {
+		glDeleteProgram(dash_program_wait(&r->request));
+		shader_variant_release(r->request.vertex);
+		shader_variant_release(r->request.fragment);
+		r->building = 0;
+	}
+
+	dash_shader_accept(r, 0);
+	shader_variant_release(r->vertex_shader);
+	shader_variant_release(r->fragment_shader);
+	r->vertex_shader = 0;
+	r->fragment_shader = 0;
+
+	if(r->fd >= 0) {
+		close(r->fd);
+	}
+	r->fd = -1;
+
+}
+
+#else
+
+int dash_shader_watch(const char *vertex, const char *fragment, const char **defines, GLuint program, shader_reload *r) {
+
+	memset(r, 0, sizeof(shader_reload));
+	r->fd = -1;
+	r->program = program;
+	return 0;
+
+}
+
+int dash_shader_reload(shader_reload *r) {
+
+	return 0;
+
+}
+
+void dash_shader_unwatch(shader_reload *r) {
+
+}
+
+#endif
+
+void dash_shader_accept(shader_reload *r, int accept) {
+
+	if(r->candidate == 0) {
+		return;
+	}
+
+	if(accept) {
+		// The replaced program's variants go unless something else uses them
+		glDeleteProgram(r->program);
+		shader_variant_release(r->vertex_shader);
+		shader_variant_release(r->fragment_shader);
+		r->program = r->candidate;
+		r->vertex_shader = r->request.vertex;
+		r->fragment_shader = r->request.fragment;
+	} else {
+		fprintf(stderr, "Shader reload rejected, keeping the previous program\n");
+		glDeleteProgram(r->candidate);
+		shader_variant_release(r->request.vertex);
+		shader_variant_release(r->request.fragment);
+	}
+
+	r->candidate = 0;
+
+}
+
+/*
+ * Reflection and uniform filtering. dash_program_reflect lists every active
+ * attribute and uniform once, after linking, into arrays indexed by small
+ * open addressed hash tables, so later lookups are by name without a GL
+ * round trip. Each uniform keeps a copy of the last value sent; the
+ * dash_uniform_* setters compare against it and skip the glUniform call
+ * when nothing changed. The program must be current when they are called.
+ */
+
+static int variable_table_build(program_variable *vars, int count, int **table, int *mask) {
+
+	int i, size, slot;
+
+	size = 8;
+	while(size < count * 2) {
+		size *= 2;
+	}
+
+	*table = (int*)malloc(sizeof(int) * size);
+	if(*table == NULL) {
+		return 0;
+	}
+
+	for(i = 0; i < size; i++) {
+		(*table)[i] = -1;
+	}
+
+	*mask = size - 1;
+	for(i = 0; i < count; i++) {
+		slot = vars[i].hash & *mask;
+		while((*table)[slot] != -1) {
+			slot = (slot + 1) & *mask;
+		}
+		(*table)[slot] = i;
+	}
+
+	return 1;
+
+}
+
+static int variable_table_find(program_variable *vars, int *table, int mask, const char *name) {
+
+	unsigned int hash = (unsigned int)hash_string(14695981039346656037ULL, name);
+	int slot = hash & mask;
+
+	while(table[slot] != -1) {
+		if(vars[table[slot]].hash == hash && !strcmp(vars[table[slot]].name, name)) {
+			return table[slot];
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	return -1;
+
+}
+
+static int variable_list(GLuint program, int uniforms, program_variable **out, int *count) {
+
+	int i, n;
+	char *bracket;
+	GLint active;
+	GLsizei len;
+	program_variable *v;
+
+	glGetProgramiv(program, uniforms ? GL_ACTIVE_UNIFORMS : GL_ACTIVE_ATTRIBUTES, &active);
+
+	*count = 0;
+	*out = (program_variable*)calloc(active > 0 ? active : 1, sizeof(program_variable));
+	if(*out == NULL) {
+		return 0;
+	}
+
+	for(i = 0, n = 0; i < active; i++) {
+		v = &(*out)[n];
+		if(uniforms) {
+			glGetActiveUniform(program, i, sizeof(v->name), &len, &v->size, &v->type, v->name);
+		} else {
+			glGetActiveAttrib(program, i, sizeof(v->name), &len, &v->size, &v->type, v->name);
+		}
+
+		// Skip built-ins such as gl_Vertex, they have no location
+		if(!strncmp(v->name, "gl_", 3)) {
+			continue;
+		}
+
+		// Arrays are reported as "name[0]", look them up by the bare name
+		bracket = strstr(v->name, "[0]");
+		if(bracket != NULL && bracket[3] == '\0') {
+			*bracket = '\0';
+		}
+
+		if(uniforms) {
+			v->location = glGetUniformLocation(program, v->name);
+		} else {
+			v->location = glGetAttribLocation(program, v->name);
+		}
+		v->hash = (unsigned int)hash_string(14695981039346656037ULL, v->name);
+		n++;
+	}
+
+	*count = n;
+	return 1;
+
+}
+
+int dash_program_reflect(GLuint program, program_reflection *r) {
+
+	memset(r, 0, sizeof(program_reflection));
+	r->program = program;
+
+	if(!variable_list(program, 1, &r->uniforms, &r->uniform_count) ||
+		!variable_list(program, 0, &r->attributes, &r->attribute_count) ||
+		!variable_table_build(r->uniforms, r->uniform_count, &r->uniform_table, &r->uniform_mask) ||
+		!variable_table_build(r->attributes, r->attribute_count, &r->attribute_table, &r->attribute_mask)) {
+		fprintf(stderr, "Could not allocate program reflection\n");
+		dash_program_reflection_free(r);
+		return 0;
+	}
+
+	return 1;
+
+}
+
+void dash_program_reflection_free(program_reflection *r) {
+
+	free(r->uniforms);
+	free(r->attributes);
+	free(r->uniform_table);
+	free(r->attribute_table);
+	memset(r, 0, sizeof(program_reflection));
+
+}
+
+int dash_uniform_index(program_reflection *r, const char *name) {
+
+	if(r->uniform_table == NULL) {
+		return -1;
+	}
+
+	return variable_table_find(r->uniforms, r->uniform_table, r->uniform_mask, name);
+
+}
+
+GLint dash_uniform_location(program_reflection *r, const char *name) {
+
+	int i = dash_uniform_index(r, name);
+	return i == -1 ? -1 : r->uniforms[i].location;
+
+}
+
+GLint dash_attrib_location(program_reflection *r, const char *name) {
+
+	int i;
+
+	if(r->attribute_table == NULL) {
+		return -1;
+	}
+
+	i = variable_table_find(r->attributes, r->attribute_table, r->attribute_mask, name);
+	return i == -1 ? -1 : r->attributes[i].location;
+
+}
+
+// Returns the location to upload to, or -1 when the value is already there
+static GLint uniform_changed(program_reflection *r, int index, const void *data, size_t bytes) {
+
+	program_variable *v;
+
+	if(index < 0 || index >= r->uniform_count) {
+		return -1;
+	}
+
+	v = &r->uniforms[index];
+	if(bytes > sizeof(v->value)) {
+		r->uploads++;
+		return v->location;
+	}
+
+	if(v->set && !memcmp(v->value, data, bytes)) {
+		r->skipped++;
+		return -1;
+	}
+
+	memcpy(v->value, data, bytes);
+	v->set = 1;
+	r->uploads++;
+	return v->location;
+
+}
+
+void dash_uniform_1i(program_reflection *r, int index, GLint value) {
+
+	GLint location = uniform_changed(r, index, &value, sizeof(value));
+	if(location != -1) {
+		glUniform1i(location, value);
+	}
+
+}
+
+void dash_uniform_1f(program_reflection *r, int index, GLfloat value) {
+
+	GLint location = uniform_changed(r, index, &value, sizeof(value));
+	if(location != -1) {
+		glUniform1f(location, value);
+	}
+
+}
+
+void dash_uniform_3fv(program_reflection *r, int index, const GLfloat *value) {
+
+	GLint location = uniform_changed(r, index, value, sizeof(GLfloat) * 3);
+	if(location != -1) {
+		glUniform3fv(location, 1, value);
+	}
+
+}
+
+void dash_uniform_4fv(program_reflection *r, int index, const GLfloat *value) {
+
+	GLint location = uniform_changed(r, index, value, sizeof(GLfloat) * 4);
+	if(location != -1) {
+		glUniform4fv(location, 1, value);
+	}
+
+}
+
+void dash_uniform_matrix4fv(program_reflection *r, int index, const GLfloat *value) {
+
+	GLint location = uniform_changed(r, index, value, sizeof(GLfloat) * 16);
+	if(location != -1) {
+		glUniformMatrix4fv(location, 1, GL_FALSE, value);
+	}
+
+}
+
+/*
+ * Shader warm-up. Drivers often finish compiling, or recompile for the
+ * current vertex layout and blend state, on the first draw with a program.
+ * dash_warmup_run draws one triangle per registered combination into a one
+ * pixel scissor so that cost is paid while loading, and glFinish after each
+ * draw lets the time be charged to the entry that caused it. A vao of 0 uses
+ * whatever vertex state is bound when dash_warmup_run is called, which must
+ * have at least three vertices. The pixel is overwritten by the next clear.
+ */
+
+int dash_warmup_add(warmup_list *w, GLuint program, GLuint vao, GLenum blend_src, GLenum blend_dst) {
+
+	int capacity;
+	warmup_entry *grown;
+
+	if(w->count == w->capacity) {
+		capacity = w->capacity ? w->capacity * 2 : 8;
+		grown = (warmup_entry*)realloc(w->entries, sizeof(warmup_entry) * capacity);
+		if(grown == NULL) {
+			fprintf(stderr, "Could not grow warm-up list to %d\n", capacity);
+			return 0;
+		}
+		w->entries = grown;
+		w->capacity = capacity;
+	}
+
+	w->entries[w->count].program = program;
+	w->entries[w->count].vao = vao;
+	w->entries[w->count].blend_src = blend_src;
+	w->entries[w->count].blend_dst = blend_dst;
+	w->entries[w->count].ms = 0.0;
+	w->count++;
+
+	return 1;
+
+}
+
+double dash_warmup_run(warmup_list *w) {
+
+	int i;
+	double start, total = 0.0;
+	warmup_entry *e;
+	GLint program, vao = 0, scissor[4], blend[4];
+	GLboolean scissor_test, blend_enabled;
+	int has_vao = GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object;
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	glGetIntegerv(GL_SCISSOR_BOX, scissor);
+	glGetIntegerv(GL_BLEND_SRC_RGB, &blend[0]);
+	glGetIntegerv(GL_BLEND_DST_RGB, &blend[1]);
+	glGetIntegerv(GL_BLEND_SRC_ALPHA, &blend[2]);
+	glGetIntegerv(GL_BLEND_DST_ALPHA, &blend[3]);
+	scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+	blend_enabled = glIsEnabled(GL_BLEND);
+	if(has_vao) {
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+	}
+
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(0, 0, 1, 1);
+	glFinish();
+
+	for(i = 0; i < w->count; i++) {
+		e = &w->entries[i];
+		start = now_ms();
+
+		glUseProgram(e->program);
+		if(e->vao != 0 && has_vao) {
+			glBindVertexArray(e->vao);
+		}
+
+		// GL_ONE, GL_ZERO is the same result as blending disabled
+		if(e->blend_src == GL_ONE && e->blend_dst == GL_ZERO) {
+			glDisable(GL_BLEND);
+		} else {
+			glEnable(GL_BLEND);
+			glBlendFunc(e->blend_src, e->blend_dst);
+		}
+
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glFinish();
+
+		if(e->vao != 0 && has_vao) {
+			glBindVertexArray(vao);
+		}
+
+		e->ms = now_ms() - start;
+		total += e->ms;
+	}
+
+	glUseProgram(program);
+	glScissor(scissor[0], scissor[1], scissor[2], scissor[3]);
+	glBlendFuncSeparate(blend[0], blend[1], blend[2], blend[3]);
+	if(!scissor_test) {
+		glDisable(GL_SCISSOR_TEST);
+	}
+	if(blend_enabled) {
+		glEnable(GL_BLEND);
+	} else {
+		glDisable(GL_BLEND);
+	}
+
+	return total;
+
+}
+
+void dash_warmup_free(warmup_list *w) {
+
+	free(w->entries);
+	w->entries = NULL;
+	w->count = 0;
+	w->capacity = 0;
+
+}
+
+/*
+ * Mipmaps. dash_texture_load builds a full chain and samples it trilinearly
+ * unless told otherwise. DASH_MIPMAP_GENERATE uses glGenerateMipmap and falls
+ * back to the CPU when the context lacks it; DASH_MIPMAP_CPU always uses the
+ * 2x2 box filter below, for drivers where glGenerateMipmap is slow.
+ */
+
+static int mipmap_mode = DASH_MIPMAP_GENERATE;
+
+/*
+ * Load-time transforms. dash_texture_transform sets DASH_IMAGE_* flags for
+ * the textures loaded after it: FLIP_Y stores the image bottom row first, the
+ * way GL texture coordinates expect, so shaders need not flip; PREMULTIPLY
+ * scales color by alpha for GL_ONE, GL_ONE_MINUS_SRC_ALPHA blending and for
+ * mip levels that do not bleed the color of transparent texels; SWAP_RB
+ * exchanges red and blue. They are applied while decoding, so they cost
+ * nothing per fragment.
+ */
+
+static int texture_flags;
+
+typedef struct {
+	unsigned char *data;
+	int width;
+	int height;
+	int channels;
+} decoded_image;
+
+/*
+ * Pixel and internal formats by channel count. One and two channel images
+ * use R8 and RG8 with a swizzle that reads them back as grey and grey plus
+ * alpha, the way the luminance formats did; contexts without texture_rg or
+ * texture_swizzle get those luminance formats instead. Either way a mask
+ * takes one byte per texel rather than four.
+ */
+
+static void texture_formats(int channels, GLenum *format, GLint *internal, int *swizzle) {
+
+	*swizzle = 0;
+
+	switch(channels) {
+		case 1:
+		case 2:
+			#ifndef GL_ES_VERSION_2_0
+			if((GLEW_VERSION_3_0 || GLEW_ARB_texture_rg) &&
+				(GLEW_VERSION_3_3 || GLEW_ARB_texture_swizzle)) {
+				*format = channels == 1 ? GL_RED : GL_RG;
+				*internal = channels == 1 ? GL_R8 : GL_RG8;
+				*swizzle = 1;
+				return;
+			}
+			*format = channels == 1 ? GL_LUMINANCE : GL_LUMINANCE_ALPHA;
+			*internal = channels == 1 ? GL_LUMINANCE8 : GL_LUMINANCE8_ALPHA8;
+			#else
+			*format = channels == 1 ? GL_LUMINANCE : GL_LUMINANCE_ALPHA;
+			*internal = *format;
+			#endif
+		break;
+		case 3:
+			*format = GL_RGB;
+			*internal = GL_RGB8;
+		break;
+		default:
+			*format = GL_RGBA;
+			*internal = GL_RGBA8;
+		break;
+	}
+
+	#ifdef GL_ES_VERSION_2_0
+	// ES 2.0 only takes unsized internal formats
+	*internal = *format;
+	#endif
+
+}
+
+static void texture_swizzle(int channels) {
+
+	#ifndef GL_ES_VERSION_2_0
+	GLint grey[4] = { GL_RED, GL_RED, GL_RED, channels == 1 ? GL_ONE : GL_GREEN };
+	glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, grey);
+	#endif
+
+}
+
+void dash_texture_mipmaps(int mode) {
+
+	mipmap_mode = mode;
+
+}
+
+void dash_texture_transform(int flags) {
+
+	texture_flags = flags;
+
+}
+
+/*
+ * Bytes needed to build a mip chain below level 0 in one buffer. Each level
+ * is written right after the one it is made from, wrapping to the start, so
+ * levels 1 and 2 back to back bound every later pair. That is not half of
+ * level 0: once a side reaches 1, each level only halves the one before.
+ */
+
+static size_t mip_scratch_size(int width, int height, int channels) {
+
+	int w1, h1, w2, h2;
+
+	w1 = width > 1 ? width / 2 : 1;
+	h1 = height > 1 ? height / 2 : 1;
+	w2 = w1 > 1 ? w1 / 2 : 1;
+	h2 = h1 > 1 ? h1 / 2 : 1;
+
+	return ((size_t)w1 * h1 + (size_t)w2 * h2) * channels;
+
+}
+
+// With from_pbo set, level 0 comes from offset 0 of the bound unpack buffer
+static void texture_upload(decoded_image *img, int mode, int from_pbo) {
+
+	int level, dw, dh, channels, width, height, swizzle;
+	GLenum format;
+	GLint internal;
+	const unsigned char *data;
+	unsigned char *level_data, *next;
+
+	data = img->data;
+	width = img->width;
+	height = img->height;
+	channels = img->channels;
+	texture_formats(channels, &format, &internal, &swizzle);
+
+	if(mode == DASH_MIPMAP_GENERATE && !GLEW_VERSION_3_0 && !GLEW_ARB_framebuffer_object) {
+		mode = DASH_MIPMAP_CPU;
+	}
+
+	// RGB rows and small mip levels are not 4-byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, internal, width, height, 0, format, GL_UNSIGNED_BYTE, from_pbo ? NULL : data);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	if(swizzle) {
+		texture_swizzle(channels);
+	}
+
+	if(from_pbo) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	if(mode == DASH_MIPMAP_NONE) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		return;
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+	if(mode == DASH_MIPMAP_GENERATE) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+		return;
+	}
+
+	level_data = (unsigned char*)malloc(mip_scratch_size(width, height, channels));
+	if(level_data == NULL) {
+		fprintf(stderr, "Could not allocate mipmaps, using level 0 only\n");
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		return;
+	}
+
+	next = level_data;
+	for(level = 1; width > 1 || height > 1; level++) {
+		dw = width > 1 ? width / 2 : 1;
+		dh = height > 1 ? height / 2 : 1;
+		dash_image_downsample(data, width, height, channels, next);
+		glTexImage2D(GL_TEXTURE_2D, level, internal, dw, dh, 0, format, GL_UNSIGNED_BYTE, next);
+
+		data = next;
+		next = next == level_data ? level_data + (size_t)dw * dh * channels : level_data;
+		width = dw;
+		height = dh;
+	}
+
+	free(level_data);
+
+}
+
+static int image_decode(const char *filename, int flags, decoded_image *img) {
+
+	FILE *fp;
+	png_structp png_ptr;
+	png_infop info_ptr;
+	int y, color_type, bit_depth;
+	size_t rowbytes;
+	unsigned char header[8];
+	unsigned char *data;
+	png_bytep *rows;
+
+	fp = fopen(filename, "rb");
+	if(fp == NULL) {
+		fprintf(stderr, "Could not open %s for reading\n", filename);
+		return 0;
+	}
+
+	if(fread(header, 1, 8, fp) != 8 || png_sig_cmp(header, 0, 8)) {
+		fprintf(stderr, "%s is not a valid png file\n", filename);
+		fclose(fp);
+		return 0;
+	}
+
+	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if(png_ptr == NULL) {
+		fclose(fp);
+		return 0;
+	}
+
+	info_ptr = png_create_info_struct(png_ptr);
+	if(info_ptr == NULL) {
+		png_destroy_read_struct(&png_ptr, NULL, NULL);
+		fclose(fp);
+		return 0;
+	}
+
+	if(setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		fclose(fp);
+		return 0;
+	}
+
+	png_init_io(png_ptr, fp);
+	png_set_sig_bytes(png_ptr, 8);
+	png_read_info(png_ptr, info_ptr);
+
+	img->width = png_get_image_width(png_ptr, info_ptr);
+	img->height = png_get_image_height(png_ptr, info_ptr);
+	color_type = png_get_color_type(png_ptr, info_ptr);
+	bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+
+	// Everything becomes 8 bits per channel in 1 to 4 channels: palettes
+	// expand to RGB, low bit grey to 8 bits, transparency chunks to an alpha
+	// channel, and 16 bit samples are cut to their high byte
+	if(color_type == PNG_COLOR_TYPE_PALETTE) {
+		png_set_palette_to_rgb(png_ptr);
+	}
+	if(color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
+		png_set_expand_gray_1_2_4_to_8(png_ptr);
+	}
+	if(png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
+		png_set_tRNS_to_alpha(png_ptr);
+	}
+	if(bit_depth == 16) {
+		png_set_strip_16(png_ptr);
+	}
+
+	png_set_interlace_handling(png_ptr);
+	png_read_update_info(png_ptr, info_ptr);
+	img->channels = png_get_channels(png_ptr, info_ptr);
+
+	// libpng decodes straight into one buffer through row pointers into it,
+	// so there is no per-row allocation and no second copy
+	rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+	data = (unsigned char*)malloc(rowbytes * img->height);
+	rows = (png_bytep*)malloc(sizeof(png_bytep) * img->height);
+	if(data == NULL || rows == NULL) {
+		fprintf(stderr, "Could not allocate %dx%d image %s\n", img->width, img->height, filename);
+		free(data);
+		free(rows);
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		fclose(fp);
+		return 0;
+	}
+
+	// A vertical flip is free here: the row pointers just run backwards
+	for(y = 0; y < img->height; y++) {
+		rows[y] = data + (flags & DASH_IMAGE_FLIP_Y ? img->height - 1 - y : y) * rowbytes;
+	}
+
+	if(setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		fclose(fp);
+		free(data);
+		free(rows);
+		return 0;
+	}
+
+	png_read_image(png_ptr, rows);
+	fclose(fp);
+
+	free(rows);
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+
+	dash_image_transform(data, img->width, img->height, img->channels, flags & ~DASH_IMAGE_FLIP_Y);
+	img->data = data;
+	return 1;
+
+}
+
+GLuint dash_texture_load(const char *filename) {
+
+	GLuint texture_id;
+	decoded_image img;
+
+	if(!image_decode(filename, texture_flags, &img)) {
+		return 0;
+	}
+
+	glGenTextures(1, &texture_id);
+	glBindTexture(GL_TEXTURE_2D, texture_id);
+	texture_upload(&img, mipmap_mode, 0);
+	free(img.data);
+
+	return texture_id;
+
+}
+
+/*
+ * Cooked textures. dash_texture_cook decodes a PNG once and writes it as a
+ * .dtex file: a fixed header holding the GL formats and a table of levels,
+ * then the full mip chain, each level starting on a 4 KiB page. The formats
+ * are chosen for the current context and the current transform flags are
+ * baked in, so cook on the kind of context the file will be loaded on; a
+ * file whose formats this context would not pick is rejected.
+ * dash_texture_load_cooked maps the file and passes each level straight
+ * from the mapping to glTexImage2D, with no decode and no copy of its own.
+ * DASH_MIPMAP_NONE loads level 0 only; otherwise the cooked chain is used.
+ */
+
+#define DTEX_MAGIC 0x58455444
+#define DTEX_VERSION 1
+#define DTEX_ALIGN 4096
+#define DTEX_LEVELS 16
+
+typedef struct {
+	unsigned int offset;
+	unsigned int size;
+	unsigned int width;
+	unsigned int height;
+} dtex_level;
+
+typedef struct {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int width;
+	unsigned int height;
+	unsigned int channels;
+	unsigned int levels;
+	unsigned int internal;
+	unsigned int format;
+	unsigned int swizzle;
+	unsigned int flags;
+	dtex_level level[DTEX_LEVELS];
+} dtex_header;
+
+int dash_texture_cook(const char *source, const char *filename) {
+
+	FILE *fp;
+	char tmp[1040];
+	int i, ok, swizzle, width, height;
+	unsigned long long offset;
+	GLenum format;
+	GLint internal;
+	decoded_image img;
+	dtex_header header;
+	unsigned char *data, *next, *level_data;
+
+	if(!image_decode(source, texture_flags, &img)) {
+		return 0;
+	}
+
+	texture_formats(img.channels, &format, &internal, &swizzle);
+
+	memset(&header, 0, sizeof(header));
+	header.magic = DTEX_MAGIC;
+	header.version = DTEX_VERSION;
+	header.width = img.width;
+	header.height = img.height;
+	header.channels = img.channels;
+	header.internal = internal;
+	header.format = format;
+	header.swizzle = swizzle;
+	header.flags = texture_flags;
+
+	// Lay out the chain down to 1x1, each level on its own page
+	width = img.width;
+	height = img.height;
+	offset = DTEX_ALIGN;
+	for(i = 0; i < DTEX_LEVELS; i++) {
+		header.level[i].offset = (unsigned int)offset;
+		header.level[i].size = (unsigned int)width * height * img.channels;
+		header.level[i].width = width;
+		header.level[i].height = height;
+		header.levels++;
+		offset += (header.level[i].size + DTEX_ALIGN - 1) / DTEX_ALIGN * DTEX_ALIGN;
+		if(width == 1 && height == 1) {
+			break;
+		}
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	level_data = (unsigned char*)malloc(mip_scratch_size(img.width, img.height, img.channels));
+	if(i == DTEX_LEVELS || offset > 0xFFFFFFFFULL || level_data == NULL) {
+		fprintf(stderr, "Could not cook %dx%d image %s\n", img.width, img.height, source);
+		free(level_data);
+		free(img.data);
+		return 0;
+	}
+
+	// Write beside the final name and rename, so readers never see half a file
+	snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+	fp = fopen(tmp, "wb");
+	if(fp == NULL) {
+		fprintf(stderr, "Could not open %s for writing\n", tmp);
+		free(level_data);
+		free(img.data);
+		return 0;
+	}
+
+	ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	data = img.data;
+	next = level_data;
+	for(i = 0; ok && i < (int)header.levels; i++) {
+		if(i > 0) {
+			dash_image_downsample(data, header.level[i - 1].width, header.level[i - 1].height, img.channels, next);
+			data = next;
+			next = next == level_data ? level_data + header.level[i].size : level_data;
+		}
+		// Seeking past the end leaves the padding to the filesystem
+		ok = fseek(fp, header.level[i].offset, SEEK_SET) == 0 &&
+			fwrite(data, 1, header.level[i].size, fp) == header.level[i].size;
+	}
+
+	if(fclose(fp) != 0 || !ok || rename(tmp, filename) != 0) {
+		fprintf(stderr, "Could not write %s\n", filename);
+		remove(tmp);
+		ok = 0;
+	}
+
+	free(level_data);
+	free(img.data);
+	return ok;
+
+}
+
+// The whole file, mapped where mmap is available and read in otherwise
+static const unsigned char *dtex_open(const char *filename, size_t *size) {
+
+	#ifdef __linux__
+	int fd;
+	struct stat st;
+	void *file;
+
+	fd = open(filename, O_RDONLY);
+	if(fd == -1) {
+		return NULL;
+	}
+
+	if(fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	// The mapping keeps the file open by itself
+	file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(file == MAP_FAILED) {
+		return NULL;
+	}
+
+	madvise(file, st.st_size, MADV_WILLNEED);
+	*size = st.st_size;
+	return (const unsigned char*)file;
+	#else
+	FILE *fp;
+	long length;
+	unsigned char *file;
+
+	fp = fopen(filename, "rb");
+	if(fp == NULL) {
+		return NULL;
+	}
+
+	if(fseek(fp, 0, SEEK_END) != 0 || (length = ftell(fp)) <= 0 || fseek(fp, 0, SEEK_SET) != 0) {
+		fclose(fp);
+		return NULL;
+	}
+
+	file = (unsigned char*)malloc(length);
+	if(file == NULL || fread(file, 1, length, fp) != (size_t)length) {
+		free(file);
+		fclose(fp);
+		return NULL;
+	}
+
+	fclose(fp);
+	*size = length;
+	return file;
+	#endif
+
+}
+
+static void dtex_close(const unsigned char *file, size_t size) {
+
+	#ifdef __linux__
+	munmap((void*)file, size);
+	#else
+	free((void*)file);
+	#endif
+
+}
+
+/*
+ * Everything glTexImage2D will read is checked against the file: the
+ * formats must be the ones this context picks for the channel count, so the
+ * texel size matches the level sizes, and each level must be half the one
+ * before, so the texture is complete.
+ */
+
+static int dtex_valid(const dtex_header *header, size_t size) {
+
+	unsigned int i, width, height;
+	int swizzle;
+	GLenum format;
+	GLint internal;
+	const dtex_level *level;
+
+	if(size < sizeof(dtex_header) || header->magic != DTEX_MAGIC || header->version != DTEX_VERSION ||
+		header->channels < 1 || header->channels > 4 || header->levels < 1 || header->levels > DTEX_LEVELS) {
+		return 0;
+	}
+
+	texture_formats(header->channels, &format, &internal, &swizzle);
+	if(header->format != format || header->internal != (unsigned int)internal ||
+		header->swizzle != (unsigned int)swizzle) {
+		return 0;
+	}
+
+	width = header->width;
+	height = header->height;
+	for(i = 0; i < header->levels; i++) {
+		level = &header->level[i];
+		if(level->width != width || level->height != height || width == 0 || height == 0 ||
+			level->offset % DTEX_ALIGN != 0 ||
+			(unsigned long long)level->width * level->height * header->channels != level->size ||
+			(unsigned long long)level->offset + level->size > size) {
+			return 0;
+		}
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	// A partial chain would leave a mipmapped texture incomplete
+	level = &header->level[header->levels - 1];
+	return level->width == 1 && level->height == 1;
+
+}
+
+GLuint dash_texture_load_cooked(const char *filename) {
+
+	int i, levels;
+	size_t size;
+	GLuint texture_id;
+	const unsigned char *file;
+	const dtex_header *header;
+
+	file = dtex_open(filename, &size);
+	if(file == NULL) {
+		fprintf(stderr, "Could not open %s for reading\n", filename);
+		return 0;
+	}
+
+	header = (const dtex_header*)file;
+	if(!dtex_valid(header, size)) {
+		fprintf(stderr, "%s is not a valid dtex file for this context\n", filename);
+		dtex_close(file, size);
+		return 0;
+	}
+
+	if(header->flags != (unsigned int)texture_flags) {
+		fprintf(stderr, "%s was cooked with transform flags %u, not %d\n", filename, header->flags, texture_flags);
+	}
+
+	levels = mipmap_mode == DASH_MIPMAP_NONE ? 1 : header->levels;
+
+	glGenTextures(1, &texture_id);
+	glBindTexture(GL_TEXTURE_2D, texture_id);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	for(i = 0; i < levels; i++) {
+		glTexImage2D(GL_TEXTURE_2D, i, header->internal, header->level[i].width, header->level[i].height,
+			0, header->format, GL_UNSIGNED_BYTE, file + header->level[i].offset);
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	if(header->swizzle) {
+		texture_swizzle(header->channels);
+	}
+
+	dtex_close(file, size);
+	return texture_id;
+
+}
+
+/*
+ * Texture registry. dash_texture_acquire loads through a table keyed by
+ * canonical path, and after decoding by a hash of the pixels, so the same
+ * file or an identical image under another name shares one texture. Each
+ * acquire takes a reference and dash_texture_release drops one; the texture
+ * is deleted with the last. The mipmap mode is part of both keys, since it
+ * changes what is uploaded. The transform flags are part of the path key
+ * only, as the pixel hash already sees what they change. dash_texture_memory
+ * reports the bytes held by registry textures, counting a third extra for
+ * mip chains.
+ */
+
+typedef struct texture_record {
+	GLuint texture;
+	unsigned long long content[2];
+	int width, height, channels;
+	int mode;
+	int refs;
+	int pending;
+	int failed;
+	size_t bytes;
+	struct texture_record *next;
+} texture_record;
+
+typedef struct texture_alias {
+	char *path;
+	int mode;
+	int flags;
+	texture_record *record;
+	struct texture_alias *next;
+} texture_alias;
+
+static texture_record *texture_records;
+static texture_alias *texture_aliases;
+static size_t texture_bytes;
+
+/*
+ * Two 64 bit hashes over the pixels, both taken in one pass. Each round
+ * rotates and multiplies, so a change in any bit reaches the low bits of
+ * the state before the next word comes in, and a murmur finalizer spreads
+ * the result. Sharing a texture takes both hashes and the size to match.
+ */
+
+static unsigned long long hash_rotl(unsigned long long x, int r) {
+
+	return (x << r) | (x >> (64 - r));
+
+}
+
+static unsigned long long hash_final(unsigned long long h) {
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	return h;
+
+}
+
+static void hash_pixels(const decoded_image *img, unsigned long long content[2]) {
+
+	size_t i, len;
+	unsigned long long h1, h2, word;
+
+	len = (size_t)img->width * img->height * img->channels;
+	h1 = 0x9e3779b97f4a7c15ULL ^ len;
+	h2 = 0x6a09e667f3bcc909ULL ^ len;
+
+	for(i = 0; i < len; i += 8) {
+		word = 0;
+		memcpy(&word, img->data + i, len - i < 8 ? len - i : 8);
+		h1 ^= hash_rotl(word * 0x87c37b91114253d5ULL, 31) * 0x4cf5ad432745937fULL;
+		h1 = hash_rotl(h1, 27) * 5 + 0x52dce729;
+		h2 += hash_rotl(word ^ 0xa0761d6478bd642fULL, 29) * 0xe7037ed1a0b428dbULL;
+		h2 = hash_rotl(h2, 33) * 0x8ebc6af09c88c6e3ULL;
+	}
+
+	content[0] = hash_final(h1);
+	content[1] = hash_final(h2 ^ h1);
+
+}
+
+static int texture_alias_add(const char *path, texture_record *record) {
+
+	texture_alias *alias;
+
+	alias = (texture_alias*)malloc(sizeof(texture_alias));
+	if(alias == NULL || (alias->path = strdup(path)) == NULL) {
+		free(alias);
+		return 0;
+	}
+
+	alias->mode = record->mode;
+	alias->flags = texture_flags;
+	alias->record = record;
+	alias->next = texture_aliases;
+	texture_aliases = alias;
+	return 1;
+
+}
+
+GLuint dash_texture_acquire(const char *filename) {
+
+	char *path;
+	texture_alias *alias;
+	texture_record *record;
+	decoded_image img;
+	unsigned long long content[2];
+
+	path = realpath(filename, NULL);
+	if(path == NULL) {
+		fprintf(stderr, "Could not open %s for reading\n", filename);
+		return 0;
+	}
+
+	for(alias = texture_aliases; alias != NULL; alias = alias->next) {
+		if(alias->mode == mipmap_mode && alias->flags == texture_flags && !strcmp(alias->path, path)) {
+			alias->record->refs++;
+			free(path);
+			return alias->record->texture;
+		}
+	}
+
+	if(!image_decode(path, texture_flags, &img)) {
+		free(path);
+		return 0;
+	}
+
+	hash_pixels(&img, content);
+	for(record = texture_records; record != NULL; record = record->next) {
+		if(record->pending || record->failed) {
+			continue;
+		}
+		if(record->mode == mipmap_mode && record->width == img.width &&
+			record->height == img.height && record->channels == img.channels &&
+			record->content[0] == content[0] && record->content[1] == content[1]) {
+			break;
+		}
+	}
+
+	if(record == NULL) {
+		record = (texture_record*)calloc(1, sizeof(texture_record));
+		if(record == NULL) {
+			free(img.data);
+			free(path);
+			return 0;
+		}
+
+		glGenTextures(1, &record->texture);
+		glBindTexture(GL_TEXTURE_2D, record->texture);
+		texture_upload(&img, mipmap_mode, 0);
+
+		record->content[0] = content[0];
+		record->content[1] = content[1];
+		record->width = img.width;
+		record->height = img.height;
+		record->channels = img.channels;
+		record->mode = mipmap_mode;
+		record->bytes = (size_t)img.width * img.height * img.channels;
+		if(mipmap_mode != DASH_MIPMAP_NONE) {
+			record->bytes += record->bytes / 3;
+		}
+		record->next = texture_records;
+		texture_records = record;
+		texture_bytes += record->bytes;
+	}
+
+	free(img.data);
+	record->refs++;
+	texture_alias_add(path, record);
+	free(path);
+
+	return record->texture;
+
+}
+
+void dash_texture_release(GLuint texture) {
+
+	texture_record **r, *record;
+	texture_alias **a, *alias;
+
+	for(r = &texture_records; *r != NULL; r = &(*r)->next) {
+		if((*r)->texture == texture) {
+			break;
+		}
+	}
+
+	if(*r == NULL || --(*r)->refs > 0) {
+		return;
+	}
+
+	record = *r;
+	*r = record->next;
+
+	for(a = &texture_aliases; *a != NULL;) {
+		alias = *a;
+		if(alias->record == record) {
+			*a = alias->next;
+			free(alias->path);
+			free(alias);
+		} else {
+			a = &alias->next;
+		}
+	}
+
+	texture_bytes -= record->bytes;
+	glDeleteTextures(1, &record->texture);
+
+	// A queued stream job still points here; it frees the record when it
+	// drains and, seeing no references, leaves the deleted name alone
+	if(!record->pending) {
+		free(record);
+	}
+
+}
+
+int dash_texture_ready(GLuint texture) {
+
+	texture_record *record;
+
+	for(record = texture_records; record != NULL; record = record->next) {
+		if(record->texture == texture) {
+			return record->failed ? -1 : !record->pending;
+		}
+	}
+
+	return 1;
+
+}
+
+size_t dash_texture_memory() {
+
+	return texture_bytes;
+
+}
+
+/*
+ * Texture streaming. dash_texture_load_async returns a texture at once,
+ * holding a 1x1 grey placeholder, and queues the file for a pool of decode
+ * threads. dash_texture_stream_update runs once per frame on the GL thread
+ * and uploads finished images into their textures through a pixel unpack
+ * buffer, stopping once the frame's byte budget is spent (at least one image
+ * always goes, so a large one cannot stall the queue). Texture names do not
+ * change, so nothing has to be rebound when the real image arrives, and
+ * dash_texture_ready tells when it has: 0 while queued, 1 once loaded and
+ * -1 if the load failed and the placeholder stays. Streamed textures belong
+ * to the registry and are shared by path. Releasing one before it arrives
+ * cancels its upload; the record stays with the queued job until the job
+ * drains, so a texture name reused in the meantime is never written.
+ */
+
+typedef struct stream_job {
+	char *filename;
+	texture_record *record;
+	int flags;
+	int ok;
+	decoded_image img;
+	struct stream_job *next;
+} stream_job;
+
+static struct {
+	int running;
+	int thread_count;
+	size_t budget;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	stream_job *pending, *pending_tail;
+	stream_job *done, *done_tail;
+	int queued;
+	GLuint pbo;
+} stream;
+
+static void *stream_worker(void *arg) {
+
+	stream_job *job;
+
+	(void)arg;
+	pthread_mutex_lock(&stream.lock);
+	while(stream.running) {
+		if(stream.pending == NULL) {
+			pthread_cond_wait(&stream.wake, &stream.lock);
+			continue;
+		}
+
+		job = stream.pending;
+		stream.pending = job->next;
+		if(stream.pending == NULL) {
+			stream.pending_tail = NULL;
+		}
+		pthread_mutex_unlock(&stream.lock);
+
+		job->ok = image_decode(job->filename, job->flags, &job->img);
+		job->next = NULL;
+
+		pthread_mutex_lock(&stream.lock);
+		if(stream.done_tail) {
+			stream.done_tail->next = job;
+		} else {
+			stream.done = job;
+		}
+		stream.done_tail = job;
+	}
+	pthread_mutex_unlock(&stream.lock);
+
+	return NULL;
+
+}
+
+static void simd_select();
+
+int dash_texture_stream_init(int threads, size_t budget) {
+
+	int i;
+
+	if(stream.running) {
+		return 1;
+	}
+
+	stream.threads = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+	if(stream.threads == NULL) {
+		return 0;
+	}
+
+	// The decode threads only read the kernel pointers, so choose them here
+	simd_select();
+
+	pthread_mutex_init(&stream.lock, NULL);
+	pthread_cond_init(&stream.wake, NULL);
+	stream.budget = budget;
+	stream.running = 1;
+
+	for(i = 0; i < threads; i++) {
+		if(pthread_create(&stream.threads[i], NULL, stream_worker, NULL) != 0) {
+			break;
+		}
+	}
+	stream.thread_count = i;
+
+	if(i == 0) {
+		fprintf(stderr, "Could not start texture stream threads\n");
+		dash_texture_stream_shutdown();
+		return 0;
+	}
+
+	if(GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object) {
+		glGenBuffers(1, &stream.pbo);
+	}
+
+	return 1;
+
+}
+
+GLuint dash_texture_load_async(const char *filename) {
+
+	char *path;
+	GLuint texture_id;
+	stream_job *job;
+	texture_alias *alias;
+	texture_record *record;
+	static const unsigned char grey[4] = { 128, 128, 128, 255 };
+
+	if(!stream.running) {
+		return dash_texture_acquire(filename);
+	}
+
+	path = realpath(filename, NULL);
+	if(path == NULL) {
+		fprintf(stderr, "Could not open %s for reading\n", filename);
+		return 0;
+	}
+
+	// Streamed textures share by path only; the pixels are not known yet
+	for(alias = texture_aliases; alias != NULL; alias = alias->next) {
+		if(alias->mode == mipmap_mode && alias->flags == texture_flags && !strcmp(alias->path, path)) {
+			alias->record->refs++;
+			free(path);
+			return alias->record->texture;
+		}
+	}
+
+	job = (stream_job*)calloc(1, sizeof(stream_job));
+	record = (texture_record*)calloc(1, sizeof(texture_record));
+	if(job == NULL || record == NULL) {
+		free(job);
+		free(record);
+		free(path);
+		return dash_texture_acquire(filename);
+	}
+
+	glGenTextures(1, &texture_id);
+	glBindTexture(GL_TEXTURE_2D, texture_id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+
+	record->texture = texture_id;
+	record->mode = mipmap_mode;
+	record->refs = 1;
+	record->pending = 1;
+	record->next = texture_records;
+	texture_records = record;
+	texture_alias_add(path, record);
+
+	job->filename = path;
+	job->record = record;
+	job->flags = texture_flags;
+
+	pthread_mutex_lock(&stream.lock);
+	if(stream.pending_tail) {
+		stream.pending_tail->next = job;
+	} else {
+		stream.pending = job;
+	}
+	stream.pending_tail = job;
+	stream.queued++;
+	pthread_cond_signal(&stream.wake);
+	pthread_mutex_unlock(&stream.lock);
+
+	return texture_id;
+
+}
+
+static void stream_upload(stream_job *job) {
+
+	size_t bytes;
+	void *mapped = NULL;
+
+	glBindTexture(GL_TEXTURE_2D, job->record->texture);
+	bytes = (size_t)job->img.width * job->img.height * job->img.channels;
+
+	if(stream.pbo != 0) {
+		// Orphan the buffer so the driver need not wait on the last upload
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream.pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+		mapped = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+	}
+
+	if(mapped != NULL) {
+		memcpy(mapped, job->img.data, bytes);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		texture_upload(&job->img, job->record->mode, 1);
+	} else {
+		if(stream.pbo != 0) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		texture_upload(&job->img, job->record->mode, 0);
+	}
+
+}
+
+static void stream_account(stream_job *job) {
+
+	texture_record *record = job->record;
+
+	hash_pixels(&job->img, record->content);
+	record->width = job->img.width;
+	record->height = job->img.height;
+	record->channels = job->img.channels;
+	record->bytes = (size_t)job->img.width * job->img.height * job->img.channels;
+	if(record->mode != DASH_MIPMAP_NONE) {
+		record->bytes += record->bytes / 3;
+	}
+	texture_bytes += record->bytes;
+	record->pending = 0;
+
+}
+
+/*
+ * Settles a job's record. Released ones were left to the job to free; one
+ * still pending here never got its image, so it keeps the placeholder and
+ * is marked failed, which also keeps it out of content sharing.
+ */
+
+static void stream_finish(stream_job *job) {
+
+	if(job->record->refs == 0) {
+		free(job->record);
+	} else if(job->record->pending) {
+		job->record->pending = 0;
+		job->record->failed = 1;
+	}
+
+	if(job->ok) {
+		free(job->img.data);
+	}
+	free(job->filename);
+	free(job);
+
+}
+
+int dash_texture_stream_update() {
+
+	int uploaded = 0;
+	size_t spent = 0;
+	stream_job *job;
+
+	if(!stream.running) {
+		return 0;
+	}
+
+	while(uploaded == 0 || spent < stream.budget) {
+		pthread_mutex_lock(&stream.lock);
+		job = stream.done;
+		if(job != NULL) {
+			stream.done = job->next;
+			if(stream.done == NULL) {
+				stream.done_tail = NULL;
+			}
+			stream.queued--;
+		}
+		pthread_mutex_unlock(&stream.lock);
+
+		if(job == NULL) {
+			break;
+		}
+
+		if(job->ok && job->record->refs > 0) {
+			stream_upload(job);
+			spent += (size_t)job->img.width * job->img.height * job->img.channels;
+			stream_account(job);
+		}
+
+		uploaded++;
+		stream_finish(job);
+	}
+
+	return uploaded;
+
+}
+
+int dash_texture_stream_pending() {
+
+	int queued;
+
+	if(!stream.running) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&stream.lock);
+	queued = stream.queued;
+	pthread_mutex_unlock(&stream.lock);
+
+	return queued;
+
+}
+
+void dash_texture_stream_shutdown() {
+
+	int i;
+	stream_job *job, *lists[2];
+
+	if(!stream.running) {
+		return;
+	}
+
+	pthread_mutex_lock(&stream.lock);
+	stream.running = 0;
+	pthread_cond_broadcast(&stream.wake);
+	pthread_mutex_unlock(&stream.lock);
+
+	for(i = 0; i < stream.thread_count; i++) {
+		pthread_join(stream.threads[i], NULL);
+	}
+
+	lists[0] = stream.pending;
+	lists[1] = stream.done;
+	for(i = 0; i < 2; i++) {
+		while(lists[i] != NULL) {
+			job = lists[i];
+			lists[i] = job->next;
+			stream_finish(job);
+		}
+	}
+
+	if(stream.pbo != 0) {
+		glDeleteBuffers(1, &stream.pbo);
+	}
+
+	pthread_mutex_destroy(&stream.lock);
+	pthread_cond_destroy(&stream.wake);
+	free(stream.threads);
+	memset(&stream, 0, sizeof(stream));
+
+}
+
+/******************************************************************************/
+/** CPU Dispatch                                                             **/
+/******************************************************************************/
+
+static int cpu_features = -1;
+static void simd_select();
+
+int dash_cpu_features() {
+
+	int features;
+
+	if(cpu_features != -1) {
+		return cpu_features;
+	}
+
+	features = 0;
+
+	#ifdef DASH_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse2")) {
+		features |= DASH_CPU_SSE2;
+	}
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		features |= DASH_CPU_AVX2;
+	}
+	if(__builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c")) {
+		features |= DASH_CPU_F16C;
+	}
+	#endif
+
+	#if defined(__ARM_NEON)
+	features |= DASH_CPU_NEON;
+	#endif
+
+	cpu_features = features;
+	return cpu_features;
+
+}
+
+/*
+ * Restricts dispatch to the given subset of the detected features and
+ * re-selects every kernel. Passing 0 forces the scalar reference paths.
+ * The texture stream threads read the kernels, so call it while no stream
+ * is running.
+ */
+
+void dash_cpu_override(int features) {
+
+	cpu_features = -1;
+	cpu_features = dash_cpu_features() & features;
+	simd_select();
+
+}
+
+const char *dash_simd_name() {
+
+	int features = dash_cpu_features();
+
+	if(features & DASH_CPU_AVX2) {
+		return "avx2";
+	} else if(features & DASH_CPU_SSE2) {
+		return "sse2";
+	} else if(features & DASH_CPU_NEON) {
+		return "neon";
+	}
+
+	return "scalar";
+
+}
+
+/******************************************************************************/
+/** SIMD Kernels                                                             **/
+/******************************************************************************/
+
+/*
+ * Each column of the result is a linear combination of the columns of a,
+ * weighted by the matching column of b. Columns of b are read before the
+ * same column of m is written, so m may alias either input.
+ */
+
+#ifdef DASH_X86
+
+DASH_TARGET("sse2")
+static void mat4_multiply_sse2(mat4 a, mat4 b, mat4 m) {
+
+	int i;
+	__m128 a0, a1, a2, a3, col, lo, hi;
+
+	a0 = _mm_loadu_ps(&a[0]);
+	a1 = _mm_loadu_ps(&a[4]);
+	a2 = _mm_loadu_ps(&a[8]);
+	a3 = _mm_loadu_ps(&a[12]);
+
+	for(i = 0; i < 16; i += 4) {
+		col = _mm_loadu_ps(&b[i]);
+		lo = _mm_add_ps(
+			_mm_mul_ps(a0, _mm_shuffle_ps(col, col, 0x00)),
+			_mm_mul_ps(a1, _mm_shuffle_ps(col, col, 0x55))
+		);
+		hi = _mm_add_ps(
+			_mm_mul_ps(a2, _mm_shuffle_ps(col, col, 0xAA)),
+			_mm_mul_ps(a3, _mm_shuffle_ps(col, col, 0xFF))
+		);
+		_mm_storeu_ps(&m[i], _mm_add_ps(lo, hi));
+	}
+
+}
+
+DASH_TARGET("avx2,fma")
+static void mat4_multiply_avx2(mat4 a, mat4 b, mat4 m) {
+
+	__m128 c;
+	__m256 a0, a1, a2, a3, b01, b23, r01, r23;
+
+	c = _mm_loadu_ps(&a[0]);
+	a0 = _mm256_insertf128_ps(_mm256_castps128_ps256(c), c, 1);
+	c = _mm_loadu_ps(&a[4]);
+	a1 = _mm256_insertf128_ps(_mm256_castps128_ps256(c), c, 1);
+	c = _mm_loadu_ps(&a[8]);
+	a2 = _mm256_insertf128_ps(_mm256_castps128_ps256(c), c, 1);
+	c = _mm_loadu_ps(&a[12]);
+	a3 = _mm256_insertf128_ps(_mm256_castps128_ps256(c), c, 1);
+
+	b01 = _mm256_loadu_ps(&b[0]);
+	b23 = _mm256_loadu_ps(&b[8]);
+
+	r01 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b01, b01, 0x00));
+	r01 = _mm256_fmadd_ps(a1, _mm256_shuffle_ps(b01, b01, 0x55), r01);
+	r01 = _mm256_fmadd_ps(a2, _mm256_shuffle_ps(b01, b01, 0xAA), r01);
+	r01 = _mm256_fmadd_ps(a3, _mm256_shuffle_ps(b01, b01, 0xFF), r01);
+
+	r23 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b23, b23, 0x00));
+	r23 = _mm256_fmadd_ps(a1, _mm256_shuffle_ps(b23, b23, 0x55), r23);
+	r23 = _mm256_fmadd_ps(a2, _mm256_shuffle_ps(b23, b23, 0xAA), r23);
+	r23 = _mm256_fmadd_ps(a3, _mm256_shuffle_ps(b23, b23, 0xFF), r23);
+
+	_mm256_storeu_ps(&m[0], r01);
+	_mm256_storeu_ps(&m[8], r23);
+
+}
+
+#endif
+
+#if defined(__ARM_NEON)
+
+static void mat4_multiply_neon(mat4 a, mat4 b, mat4 m) {
+
+	int i;
+	float32x4_t a0, a1, a2, a3, res;
+
+	a0 = vld1q_f32(&a[0]);
+	a1 = vld1q_f32(&a[4]);
+	a2 = vld1q_f32(&a[8]);
+	a3 = vld1q_f32(&a[12]);
+
+	for(i = 0; i < 16; i += 4) {
+		res = vmulq_n_f32(a0, b[i + 0]);
+		res = vmlaq_n_f32(res, a1, b[i + 1]);
+		res = vmlaq_n_f32(res, a2, b[i + 2]);
+		res = vmlaq_n_f32(res, a3, b[i + 3]);
+		vst1q_f32(&m[i], res);
+	}
+
+}
+
+#endif
+
+/*
+ * Batch kernels work on a block of up to DASH_BATCH objects stored as
+ * structure-of-arrays rows: cos and sin of the three euler angles, the
+ * scale and the translation. Each row becomes one register so the same
+ * instruction builds one matrix element for 4 or 8 objects at once, and
+ * the result is transposed back into mat4 order on the way out.
+ */
+
+#define DASH_BATCH 8
+
+enum {
+	BATCH_CX, BATCH_SX, BATCH_CY, BATCH_SY, BATCH_CZ, BATCH_SZ,
+	BATCH_KX, BATCH_KY, BATCH_KZ, BATCH_TX, BATCH_TY, BATCH_TZ,
+	BATCH_ROWS
+};
+
+static void compose_block_scalar(float b[BATCH_ROWS][DASH_BATCH], mat4 *m, int n) {
+
+	int i;
+	float cx, sx, cy, sy, cz, sz;
+
+	for(i = 0; i < n; i++) {
+
+		cx = b[BATCH_CX][i];
+		sx = b[BATCH_SX][i];
+		cy = b[BATCH_CY][i];
+		sy = b[BATCH_SY][i];
+		cz = b[BATCH_CZ][i];
+		sz = b[BATCH_SZ][i];
+
+		m[i][M_00] = cy*cz * b[BATCH_KX][i];
+		m[i][M_10] = (sx*sy*cz + cx*sz) * b[BATCH_KX][i];
+		m[i][M_20] = (sx*sz - cx*sy*cz) * b[BATCH_KX][i];
+		m[i][M_30] = 0.0f;
+
+		m[i][M_01] = -cy*sz * b[BATCH_KY][i];
+		m[i][M_11] = (cx*cz - sx*sy*sz) * b[BATCH_KY][i];
+		m[i][M_21] = (cx*sy*sz + sx*cz) * b[BATCH_KY][i];
+		m[i][M_31] = 0.0f;
+
+		m[i][M_02] = sy * b[BATCH_KZ][i];
+		m[i][M_12] = -sx*cy * b[BATCH_KZ][i];
+		m[i][M_22] = cx*cy * b[BATCH_KZ][i];
+		m[i][M_32] = 0.0f;
+
+		m[i][M_03] = b[BATCH_TX][i];
+		m[i][M_13] = b[BATCH_TY][i];
+		m[i][M_23] = b[BATCH_TZ][i];
+		m[i][M_33] = 1.0f;
+
+	}
+
+}
+
+#ifdef DASH_X86
+
+/*
+ * Takes the 16 elements of four matrices as SIMD rows (row k holds element k
+ * of each matrix) and transposes them back into mat4 order.
+ */
+
+DASH_TARGET("sse2")
+static void mat4_store4_sse2(__m128 r[16], mat4 *m) {
+
+	int k;
+
+	for(k = 0; k < 16; k += 4) {
+		_MM_TRANSPOSE4_PS(r[k + 0], r[k + 1], r[k + 2], r[k + 3]);
+		_mm_storeu_ps(&m[0][k], r[k + 0]);
+		_mm_storeu_ps(&m[1][k], r[k + 1]);
+		_mm_storeu_ps(&m[2][k], r[k + 2]);
+		_mm_storeu_ps(&m[3][k], r[k + 3]);
+	}
+
+}
+
+DASH_TARGET("sse2")
+static void compose_block_sse2(float b[BATCH_ROWS][DASH_BATCH], mat4 *m, int n) {
+
+	int i;
+	__m128 cx, sx, cy, sy, cz, sz, kx, ky, kz, sxsy, cxsy, zero;
+	__m128 r[16];
+
+	zero = _mm_setzero_ps();
+
+	for(i = 0; i + 4 <= n; i += 4) {
+
+		cx = _mm_loadu_ps(&b[BATCH_CX][i]);
+		sx = _mm_loadu_ps(&b[BATCH_SX][i]);
+		cy = _mm_loadu_ps(&b[BATCH_CY][i]);
+		sy = _mm_loadu_ps(&b[BATCH_SY][i]);
+		cz = _mm_loadu_ps(&b[BATCH_CZ][i]);
+		sz = _mm_loadu_ps(&b[BATCH_SZ][i]);
+		kx = _mm_loadu_ps(&b[BATCH_KX][i]);
+		ky = _mm_loadu_ps(&b[BATCH_KY][i]);
+		kz = _mm_loadu_ps(&b[BATCH_KZ][i]);
+		sxsy = _mm_mul_ps(sx, sy);
+		cxsy = _mm_mul_ps(cx, sy);
+
+		r[0] = _mm_mul_ps(_mm_mul_ps(cy, cz), kx);
+		r[1] = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(sxsy, cz), _mm_mul_ps(cx, sz)), kx);
+		r[2] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(sx, sz), _mm_mul_ps(cxsy, cz)), kx);
+		r[3] = zero;
+
+		r[4] = _mm_mul_ps(_mm_sub_ps(zero, _mm_mul_ps(cy, sz)), ky);
+		r[5] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(cx, cz), _mm_mul_ps(sxsy, sz)), ky);
+		r[6] = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(cxsy, sz), _mm_mul_ps(sx, cz)), ky);
+		r[7] = zero;
+
+		r[8] = _mm_mul_ps(sy, kz);
+		r[9] = _mm_mul_ps(_mm_sub_ps(zero, _mm_mul_ps(sx, cy)), kz);
+		r[10] = _mm_mul_ps(_mm_mul_ps(cx, cy), kz);
+		r[11] = zero;
+
+		r[12] = _mm_loadu_ps(&b[BATCH_TX][i]);
+		r[13] = _mm_loadu_ps(&b[BATCH_TY][i]);
+		r[14] = _mm_loadu_ps(&b[BATCH_TZ][i]);
+		r[15] = _mm_set1_ps(1.0f);
+
+		mat4_store4_sse2(r, m + i);
+
+	}
+
+	if(i < n) {
+		compose_block_scalar((float (*)[DASH_BATCH])&b[0][i], m + i, n - i);
+	}
+
+}
+
+/*
+ * Transposes eight rows of eight floats so that row j holds element j of
+ * every input row, then stores row j to dst[j] + offset.
+ */
+
+DASH_TARGET("avx2,fma")
+static void transpose8_store(__m256 r[8], mat4 *dst, int offset) {
+
+	int j;
+	__m256 t[8], u[8];
+
+	t[0] = _mm256_unpacklo_ps(r[0], r[1]);
+	t[1] = _mm256_unpackhi_ps(r[0], r[1]);
+	t[2] = _mm256_unpacklo_ps(r[2], r[3]);
+	t[3] = _mm256_unpackhi_ps(r[2], r[3]);
+	t[4] = _mm256_unpacklo_ps(r[4], r[5]);
+	t[5] = _mm256_unpackhi_ps(r[4], r[5]);
+	t[6] = _mm256_unpacklo_ps(r[6], r[7]);
+	t[7] = _mm256_unpackhi_ps(r[6], r[7]);
+
+	u[0] = _mm256_shuffle_ps(t[0], t[2], 0x44);
+	u[1] = _mm256_shuffle_ps(t[0], t[2], 0xEE);
+	u[2] = _mm256_shuffle_ps(t[1], t[3], 0x44);
+	u[3] = _mm256_shuffle_ps(t[1], t[3], 0xEE);
+	u[4] = _mm256_shuffle_ps(t[4], t[6], 0x44);
+	u[5] = _mm256_shuffle_ps(t[4], t[6], 0xEE);
+	u[6] = _mm256_shuffle_ps(t[5], t[7], 0x44);
+	u[7] = _mm256_shuffle_ps(t[5], t[7], 0xEE);
+
+	for(j = 0; j < 4; j++) {
+		_mm256_storeu_ps(&dst[j][offset], _mm256_permute2f128_ps(u[j], u[j + 4], 0x20));
+		_mm256_storeu_ps(&dst[j + 4][offset], _mm256_permute2f128_ps(u[j], u[j + 4], 0x31));
+	}
+
+}
+
+DASH_TARGET("avx2,fma")
+static void compose_block_avx2(float b[BATCH_ROWS][DASH_BATCH], mat4 *m, int n) {
+
+	__m256 cx, sx, cy, sy, cz, sz, kx, ky, kz, sxsy, cxsy, zero;
+	__m256 r[8];
+
+	if(n < DASH_BATCH) {
+		compose_block_sse2(b, m, n);
+		return;
+	}
+
+	zero = _mm256_setzero_ps();
+
+	cx = _mm256_loadu_ps(b[BATCH_CX]);
+	sx = _mm256_loadu_ps(b[BATCH_SX]);
+	cy = _mm256_loadu_ps(b[BATCH_CY]);
+	sy = _mm256_loadu_ps(b[BATCH_SY]);
+	cz = _mm256_loadu_ps(b[BATCH_CZ]);
+	sz = _mm256_loadu_ps(b[BATCH_SZ]);
+	kx = _mm256_loadu_ps(b[BATCH_KX]);
+	ky = _mm256_loadu_ps(b[BATCH_KY]);
+	kz = _mm256_loadu_ps(b[BATCH_KZ]);
+	sxsy = _mm256_mul_ps(sx, sy);
+	cxsy = _mm256_mul_ps(cx, sy);
+
+	r[0] = _mm256_mul_ps(_mm256_mul_ps(cy, cz), kx);
+	r[1] = _mm256_mul_ps(_mm256_fmadd_ps(sxsy, cz, _mm256_mul_ps(cx, sz)), kx);
+	r[2] = _mm256_mul_ps(_mm256_fmsub_ps(sx, sz, _mm256_mul_ps(cxsy, cz)), kx);
+	r[3] = zero;
+	r[4] = _mm256_mul_ps(_mm256_fnmadd_ps(cy, sz, zero), ky);
+	r[5] = _mm256_mul_ps(_mm256_fnmadd_ps(sxsy, sz, _mm256_mul_ps(cx, cz)), ky);
+	r[6] = _mm256_mul_ps(_mm256_fmadd_ps(cxsy, sz, _mm256_mul_ps(sx, cz)), ky);
+	r[7] = zero;
+	transpose8_store(r, m, 0);
+
+	r[0] = _mm256_mul_ps(sy, kz);
+	r[1] = _mm256_mul_ps(_mm256_fnmadd_ps(sx, cy, zero), kz);
+	r[2] = _mm256_mul_ps(_mm256_mul_ps(cx, cy), kz);
+	r[3] = zero;
+	r[4] = _mm256_loadu_ps(b[BATCH_TX]);
+	r[5] = _mm256_loadu_ps(b[BATCH_TY]);
+	r[6] = _mm256_loadu_ps(b[BATCH_TZ]);
+	r[7] = _mm256_set1_ps(1.0f);
+	transpose8_store(r, m, 8);
+
+}
+
+#endif
+
+/*
+ * Minimax sincos: reduce x by the nearest multiple of pi/2 (split into three
+ * constants so the reduction stays exact for |x| up to a few thousand), then
+ * evaluate the cephes polynomials on [-pi/4, pi/4]. The quadrant picks which
+ * polynomial lands in sin and cos and their signs. Max error is about 2 ulp.
+ */
+
+#define TRIG_2_PI 0.636619772367581343f
+#define TRIG_DP1 1.5703125f
+#define TRIG_DP2 4.837512969970703125e-4f
+#define TRIG_DP3 7.54978995489188216e-8f
+#define TRIG_S1 -1.9515295891e-4f
+#define TRIG_S2 8.3321608736e-3f
+#define TRIG_S3 -1.6666654611e-1f
+#define TRIG_C1 2.443315711809948e-5f
+#define TRIG_C2 -1.388731625493765e-3f
+#define TRIG_C3 4.166664568298827e-2f
+
+static void sincos_poly(float x, float *s, float *c) {
+
+	int q;
+	float r, z, ps, pc;
+
+	r = x * TRIG_2_PI;
+	q = (int)(r < 0.0f ? r - 0.5f : r + 0.5f);
+	r = ((x - q * TRIG_DP1) - q * TRIG_DP2) - q * TRIG_DP3;
+	z = r * r;
+
+	ps = r + r * z * ((TRIG_S1 * z + TRIG_S2) * z + TRIG_S3);
+	pc = 1.0f - 0.5f * z + z * z * ((TRIG_C1 * z + TRIG_C2) * z + TRIG_C3);
+
+	switch(q & 3) {
+		case 0:
+			*s = ps;
+			*c = pc;
+		break;
+		case 1:
+			*s = pc;
+			*c = -ps;
+		break;
+		case 2:
+			*s = -ps;
+			*c = -pc;
+		break;
+		case 3:
+			*s = -pc;
+			*c = ps;
+		break;
+	}
+
+}
+
+static void sincos_poly_scalar(const float *x, float *s, float *c, int count) {
+
+	int i;
+	for(i = 0; i < count; i++) {
+		sincos_poly(x[i], &s[i], &c[i]);
+	}
+
+}
+
+#ifdef DASH_X86
+
+DASH_TARGET("sse2")
+static void sincos_poly_sse2(const float *x, float *s, float *c, int count) {
+
+	int i;
+	__m128i q, swap, sign_s, sign_c, one, two;
+	__m128 v, qf, r, z, ps, pc;
+
+	one = _mm_set1_epi32(1);
+	two = _mm_set1_epi32(2);
+
+	for(i = 0; i + 4 <= count; i += 4) {
+
+		v = _mm_loadu_ps(&x[i]);
+		q = _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(TRIG_2_PI)));
+		qf = _mm_cvtepi32_ps(q);
+
+		r = _mm_sub_ps(v, _mm_mul_ps(qf, _mm_set1_ps(TRIG_DP1)));
+		r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(TRIG_DP2)));
+		r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(TRIG_DP3)));
+		z = _mm_mul_ps(r, r);
+
+		ps = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(TRIG_S1), z), _mm_set1_ps(TRIG_S2));
+		ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(TRIG_S3));
+		ps = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, z), ps));
+
+		pc = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(TRIG_C1), z), _mm_set1_ps(TRIG_C2));
+		pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(TRIG_C3));
+		pc = _mm_mul_ps(_mm_mul_ps(z, z), pc);
+		pc = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), z)), pc);
+
+		swap = _mm_cmpeq_epi32(_mm_and_si128(q, one), one);
+		sign_s = _mm_slli_epi32(_mm_and_si128(q, two), 30);
+		sign_c = _mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30);
+
+		v = _mm_or_ps(
+			_mm_and_ps(_mm_castsi128_ps(swap), pc),
+			_mm_andnot_ps(_mm_castsi128_ps(swap), ps)
+		);
+		_mm_storeu_ps(&s[i], _mm_xor_ps(v, _mm_castsi128_ps(sign_s)));
+
+		v = _mm_or_ps(
+			_mm_and_ps(_mm_castsi128_ps(swap), ps),
+			_mm_andnot_ps(_mm_castsi128_ps(swap), pc)
+		);
+		_mm_storeu_ps(&c[i], _mm_xor_ps(v, _mm_castsi128_ps(sign_c)));
+
+	}
+
+	sincos_poly_scalar(x + i, s + i, c + i, count - i);
+
+}
+
+DASH_TARGET("avx2,fma")
+static void sincos_poly_avx2(const float *x, float *s, float *c, int count) {
+
+	int i;
+	__m256i q, swap, sign_s, sign_c, one, two;
+	__m256 v, qf, r, z, ps, pc;
+
+	one = _mm256_set1_epi32(1);
+	two = _mm256_set1_epi32(2);
+
+	for(i = 0; i + 8 <= count; i += 8) {
+
+		v = _mm256_loadu_ps(&x[i]);
+		q = _mm256_cvtps_epi32(_mm256_mul_ps(v, _mm256_set1_ps(TRIG_2_PI)));
+		qf = _mm256_cvtepi32_ps(q);
+
+		r = _mm256_fnmadd_ps(qf, _mm256_set1_ps(TRIG_DP1), v);
+		r = _mm256_fnmadd_ps(qf, _mm256_set1_ps(TRIG_DP2), r);
+		r = _mm256_fnmadd_ps(qf, _mm256_set1_ps(TRIG_DP3), r);
+		z = _mm256_mul_ps(r, r);
+
+		ps = _mm256_fmadd_ps(_mm256_set1_ps(TRIG_S1), z, _mm256_set1_ps(TRIG_S2));
+		ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(TRIG_S3));
+		ps = _mm256_fmadd_ps(_mm256_mul_ps(r, z), ps, r);
+
+		pc = _mm256_fmadd_ps(_mm256_set1_ps(TRIG_C1), z, _mm256_set1_ps(TRIG_C2));
+		pc = _mm256_fmadd_ps(pc, z, _mm256_set1_ps(TRIG_C3));
+		pc = _mm256_fmadd_ps(_mm256_mul_ps(z, z), pc,
+			_mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, _mm256_set1_ps(1.0f)));
+
+		swap = _mm256_cmpeq_epi32(_mm256_and_si256(q, one), one);
+		sign_s = _mm256_slli_epi32(_mm256_and_si256(q, two), 30);
+		sign_c = _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30);
+
+		v = _mm256_blendv_ps(ps, pc, _mm256_castsi256_ps(swap));
+		_mm256_storeu_ps(&s[i], _mm256_xor_ps(v, _mm256_castsi256_ps(sign_s)));
+
+		v = _mm256_blendv_ps(pc, ps, _mm256_castsi256_ps(swap));
+		_mm256_storeu_ps(&c[i], _mm256_xor_ps(v, _mm256_castsi256_ps(sign_c)));
+
+	}
+
+	sincos_poly_scalar(x + i, s + i, c + i, count - i);
+
+}
+
+#endif
+
+/*
+ * Quaternion kernels load four quaternions at a time and transpose them so
+ * each register holds one component (x, y, z or w) of all four. The math is
+ * then written once per component, exactly like the scalar version. Each
+ * kernel returns how many elements it handled and the caller finishes the
+ * tail with the scalar functions.
+ */
+
+#ifdef DASH_X86
+
+DASH_TARGET("sse2")
+static void quat4_load(float *p, int stride, __m128 v[4]) {
+
+	v[0] = _mm_loadu_ps(p);
+	v[1] = _mm_loadu_ps(p + stride);
+	v[2] = _mm_loadu_ps(p + stride * 2);
+	v[3] = _mm_loadu_ps(p + stride * 3);
+	_MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+
+}
+
+DASH_TARGET("sse2")
+static void quat4_store(__m128 v[4], float *p, int stride) {
+
+	_MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+	_mm_storeu_ps(p, v[0]);
+	_mm_storeu_ps(p + stride, v[1]);
+	_mm_storeu_ps(p + stride * 2, v[2]);
+	_mm_storeu_ps(p + stride * 3, v[3]);
+
+}
+
+DASH_TARGET("sse2")
+static __m128 quat4_dot(__m128 a[4], __m128 b[4]) {
+
+	return _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])),
+		_mm_add_ps(_mm_mul_ps(a[2], b[2]), _mm_mul_ps(a[3], b[3]))
+	);
+
+}
+
+DASH_TARGET("sse2")
+static void quat4_multiply(__m128 a[4], __m128 b[4], __m128 q[4]) {
+
+	__m128 x, y, z, w;
+
+	x = _mm_add_ps(_mm_mul_ps(a[3], b[0]), _mm_mul_ps(a[0], b[3]));
+	x = _mm_add_ps(x, _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1])));
+
+	y = _mm_add_ps(_mm_mul_ps(a[3], b[1]), _mm_mul_ps(a[1], b[3]));
+	y = _mm_add_ps(y, _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2])));
+
+	z = _mm_add_ps(_mm_mul_ps(a[3], b[2]), _mm_mul_ps(a[2], b[3]));
+	z = _mm_add_ps(z, _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0])));
+
+	w = _mm_sub_ps(_mm_mul_ps(a[3], b[3]), _mm_mul_ps(a[0], b[0]));
+	w = _mm_sub_ps(w, _mm_add_ps(_mm_mul_ps(a[1], b[1]), _mm_mul_ps(a[2], b[2])));
+
+	q[0] = x;
+	q[1] = y;
+	q[2] = z;
+	q[3] = w;
+
+}
+
+DASH_TARGET("sse2")
+static void quat4_scale(__m128 a[4], __m128 k, __m128 q[4]) {
+
+	q[0] = _mm_mul_ps(a[0], k);
+	q[1] = _mm_mul_ps(a[1], k);
+	q[2] = _mm_mul_ps(a[2], k);
+	q[3] = _mm_mul_ps(a[3], k);
+
+}
+
+DASH_TARGET("sse2")
+static void quat4_normalize(__m128 a[4], __m128 q[4]) {
+
+	quat4_scale(a, _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(quat4_dot(a, a))), q);
+
+}
+
+/*
+ * Blends a and b with weights wa and wb, flipping b onto the same
+ * hemisphere as a so the blend takes the short way round.
+ */
+
+DASH_TARGET("sse2")
+static void quat4_blend(__m128 a[4], __m128 b[4], __m128 wa, __m128 wb, __m128 q[4]) {
+
+	int k;
+	__m128 sign;
+
+	sign = _mm_and_ps(
+		_mm_cmplt_ps(quat4_dot(a, b), _mm_setzero_ps()),
+		_mm_set1_ps(-0.0f)
+	);
+	wb = _mm_xor_ps(wb, sign);
+
+	for(k = 0; k < 4; k++) {
+		q[k] = _mm_add_ps(_mm_mul_ps(a[k], wa), _mm_mul_ps(b[k], wb));
+	}
+
+}
+
+/*
+ * Writes the rotation matrix of four unit quaternions as 12 SIMD rows in
+ * the layout expected by mat4_store4_sse2. The caller fills the last column.
+ */
+
+DASH_TARGET("sse2")
+static void quat4_rotation_rows(__m128 q[4], __m128 r[16]) {
+
+	__m128 one, two, zero, xx, yy, zz, xy, xz, yz, wx, wy, wz;
+
+	one = _mm_set1_ps(1.0f);
+	two = _mm_set1_ps(2.0f);
+	zero = _mm_setzero_ps();
+
+	xx = _mm_mul_ps(q[0], q[0]);
+	yy = _mm_mul_ps(q[1], q[1]);
+	zz = _mm_mul_ps(q[2], q[2]);
+	xy = _mm_mul_ps(q[0], q[1]);
+	xz = _mm_mul_ps(q[0], q[2]);
+	yz = _mm_mul_ps(q[1], q[2]);
+	wx = _mm_mul_ps(q[3], q[0]);
+	wy = _mm_mul_ps(q[3], q[1]);
+	wz = _mm_mul_ps(q[3], q[2]);
+
+	r[M_00] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+	r[M_10] = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+	r[M_20] = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+	r[M_30] = zero;
+
+	r[M_01] = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+	r[M_11] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+	r[M_21] = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+	r[M_31] = zero;
+
+	r[M_02] = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+	r[M_12] = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+	r[M_22] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+	r[M_32] = zero;
+
+}
+
+DASH_TARGET("sse2")
+static int quat_multiply_sse2(quat *a, quat *b, quat *q, int count) {
+
+	int i;
+	__m128 va[4], vb[4], vq[4];
+
+	for(i = 0; i + 4 <= count; i += 4) {
+		quat4_load(a[i], 4, va);
+		quat4_load(b[i], 4, vb);
+		quat4_multiply(va, vb, vq);
+		quat4_store(vq, q[i], 4);
+	}
+
+	return i;
+
+}
+
+DASH_TARGET("sse2")
+static int quat_normalize_sse2(quat *a, quat *q, int count) {
+
+	int i;
+	__m128 va[4];
+
+	for(i = 0; i + 4 <= count; i += 4) {
+		quat4_load(a[i], 4, va);
+		quat4_normalize(va, va);
+		quat4_store(va, q[i], 4);
+	}
+
+	return i;
+
+}
+
+DASH_TARGET("sse2")
+static int quat_nlerp_sse2(quat *a, quat *b, float *t, quat *q, int count) {
+
+	int i;
+	__m128 va[4], vb[4], vt;
+
+	for(i = 0; i + 4 <= count; i += 4) {
+		quat4_load(a[i], 4, va);
+		quat4_load(b[i], 4, vb);
+		vt = _mm_loadu_ps(&t[i]);
+		quat4_blend(va, vb, _mm_sub_ps(_mm_set1_ps(1.0f), vt), vt, va);
+		quat4_normalize(va, va);
+		quat4_store(va, q[i], 4);
+	}
+
+	return i;
+
+}
+
+/*
+ * Slerp without trig, after Eberly's "A Fast and Accurate Algorithm for
+ * Computing SLERP": the weights sin(t * theta) / sin(theta) are expanded as
+ * a polynomial in cos(theta) evaluated with Horner's rule. With 12 terms and
+ * the last one scaled by SLERP_MU the error stays under 1e-6 on [0, pi/2].
+ */
+
+#define SLERP_TERMS 12
+#define SLERP_MU 1.8928f
+
+static const float slerp_u[SLERP_TERMS] = {
+	1.0f / 3, 1.0f / 10, 1.0f / 21, 1.0f / 36, 1.0f / 55, 1.0f / 78,
+	1.0f / 105, 1.0f / 136, 1.0f / 171, 1.0f / 210, 1.0f / 253, SLERP_MU / 300
+};
+
+static const float slerp_v[SLERP_TERMS] = {
+	1.0f / 3, 2.0f / 5, 3.0f / 7, 4.0f / 9, 5.0f / 11, 6.0f / 13,
+	7.0f / 15, 8.0f / 17, 9.0f / 19, 10.0f / 21, 11.0f / 23, SLERP_MU * 12 / 25
+};
+
+DASH_TARGET("sse2")
+static int quat_slerp_sse2(quat *a, quat *b, float *t, quat *q, int count) {
+
+	int i, k;
+	__m128 va[4], vb[4], vt, vd, x, xm1, tt, dd, ct, cd, one;
+
+	one = _mm_set1_ps(1.0f);
+
+	for(i = 0; i + 4 <= count; i += 4) {
+
+		quat4_load(a[i], 4, va);
+		quat4_load(b[i], 4, vb);
+		vt = _mm_loadu_ps(&t[i]);
+		vd = _mm_sub_ps(one, vt);
+
+		x = quat4_dot(va, vb);
+		x = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+		xm1 = _mm_sub_ps(x, one);
+		tt = _mm_mul_ps(vt, vt);
+		dd = _mm_mul_ps(vd, vd);
+
+		ct = one;
+		cd = one;
+		for(k = SLERP_TERMS - 1; k >= 0; k--) {
+			ct = _mm_add_ps(one, _mm_mul_ps(ct, _mm_mul_ps(xm1,
+				_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(slerp_u[k]), tt), _mm_set1_ps(slerp_v[k])))));
+			cd = _mm_add_ps(one, _mm_mul_ps(cd, _mm_mul_ps(xm1,
+				_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(slerp_u[k]), dd), _mm_set1_ps(slerp_v[k])))));
+		}
+
+		quat4_blend(va, vb, _mm_mul_ps(vd, cd), _mm_mul_ps(vt, ct), va);
+		quat4_store(va, q[i], 4);
+
+	}
+
+	return i;
+
+}
+
+DASH_TARGET("sse2")
+static int mat4_from_quat_sse2(quat *q, mat4 *m, int count) {
+
+	int i;
+	__m128 vq[4], r[16];
+
+	for(i = 0; i + 4 <= count; i += 4) {
+		quat4_load(q[i], 4, vq);
+		quat4_rotation_rows(vq, r);
+		r[M_03] = _mm_setzero_ps();
+		r[M_13] = _mm_setzero_ps();
+		r[M_23] = _mm_setzero_ps();
+		r[M_33] = _mm_set1_ps(1.0f);
+		mat4_store4_sse2(r, m + i);
+	}
+
+	return i;
+
+}
+
+DASH_TARGET("sse2")
+static int dquat_multiply_sse2(dquat *a, dquat *b, dquat *d, int count) {
+
+	int i;
+	__m128 ar[4], ad[4], br[4], bd[4], r[4], t0[4], t1[4];
+
+	for(i = 0; i + 4 <= count; i += 4) {
+
+		quat4_load(&a[i][0], 8, ar);
+		quat4_load(&a[i][4], 8, ad);
+		quat4_load(&b[i][0], 8, br);
+		quat4_load(&b[i][4], 8, bd);
+
+		quat4_multiply(ar, br, r);
+		quat4_multiply(ar, bd, t0);
+		quat4_multiply(ad, br, t1);
+		t0[0] = _mm_add_ps(t0[0], t1[0]);
+		t0[1] = _mm_add_ps(t0[1], t1[1]);
+		t0[2] = _mm_add_ps(t0[2], t1[2]);
+		t0[3] = _mm_add_ps(t0[3], t1[3]);
+
+		quat4_store(r, &d[i][0], 8);
+		quat4_store(t0, &d[i][4], 8);
+
+	}
+
+	return i;
+
+}
+
+DASH_TARGET("sse2")
+static int dquat_nlerp_sse2(dquat *a, dquat *b, float *t, dquat *d, int count) {
+
+	int i;
+	__m128 ar[4], ad[4], br[4], bd[4], vt, wa, wb, sign, inv;
+
+	for(i = 0; i + 4 <= count; i += 4) {
+
+		quat4_load(&a[i][0], 8, ar);
+		quat4_load(&a[i][4], 8, ad);
+		quat4_load(&b[i][0], 8, br);
+		quat4_load(&b[i][4], 8, bd);
+
+		vt = _mm_loadu_ps(&t[i]);
+		wa = _mm_sub_ps(_mm_set1_ps(1.0f), vt);
+		sign = _mm_and_ps(
+			_mm_cmplt_ps(quat4_dot(ar, br), _mm_setzero_ps()),
+			_mm_set1_ps(-0.0f)
+		);
+		wb = _mm_xor_ps(vt, sign);
+
+		quat4_scale(ar, wa, ar);
+		quat4_scale(br, wb, br);
+		ar[0] = _mm_add_ps(ar[0], br[0]);
+		ar[1] = _mm_add_ps(ar[1], br[1]);
+		ar[2] = _mm_add_ps(ar[2], br[2]);
+		ar[3] = _mm_add_ps(ar[3], br[3]);
+
+		quat4_scale(ad, wa, ad);
+		quat4_scale(bd, wb, bd);
+		ad[0] = _mm_add_ps(ad[0], bd[0]);
+		ad[1] = _mm_add_ps(ad[1], bd[1]);
+		ad[2] = _mm_add_ps(ad[2], bd[2]);
+		ad[3] = _mm_add_ps(ad[3], bd[3]);
+
+		inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(quat4_dot(ar, ar)));
+		quat4_scale(ar, inv, ar);
+		quat4_scale(ad, inv, ad);
+
+		quat4_store(ar, &d[i][0], 8);
+		quat4_store(ad, &d[i][4], 8);
+
+	}
+
+	return i;
+
+}
+
+DASH_TARGET("sse2")
+static int mat4_from_dquat_sse2(dquat *d, mat4 *m, int count) {
+
+	int i;
+	__m128 vr[4], vd[4], conj[4], t[4], r[16], two;
+
+	two = _mm_set1_ps(2.0f);
+
+	for(i = 0; i + 4 <= count; i += 4) {
+
+		quat4_load(&d[i][0], 8, vr);
+		quat4_load(&d[i][4], 8, vd);
+
+		conj[0] = _mm_xor_ps(vr[0], _mm_set1_ps(-0.0f));
+		conj[1] = _mm_xor_ps(vr[1], _mm_set1_ps(-0.0f));
+		conj[2] = _mm_xor_ps(vr[2], _mm_set1_ps(-0.0f));
+		conj[3] = vr[3];
+		quat4_multiply(vd, conj, t);
+
+		quat4_rotation_rows(vr, r);
+		r[M_03] = _mm_mul_ps(two, t[0]);
+		r[M_13] = _mm_mul_ps(two, t[1]);
+		r[M_23] = _mm_mul_ps(two, t[2]);
+		r[M_33] = _mm_set1_ps(1.0f);
+		mat4_store4_sse2(r, m + i);
+
+	}
+
+	return i;
+
+}
+
+#endif
+
+/*
+ * Inverse kernels. The general inverse splits the matrix into 2x2 blocks
+ * and inverts it with block-wise adjugates. inverse(transpose(m)) equals
+ * transpose(inverse(m)), so the row-major derivation works unchanged on
+ * column-major storage. The affine and rigid versions only touch the upper
+ * 3x3 and the translation column.
+ */
+
+static int mat4_inverse_scalar(mat4 a, mat4 m) {
+
+	float b00, b01, b02, b03, b04, b05, b06, b07, b08, b09, b10, b11, det;
+	mat4 tmp;
+
+	b00 = a[0]*a[5] - a[1]*a[4];
+	b01 = a[0]*a[6] - a[2]*a[4];
+	b02 = a[0]*a[7] - a[3]*a[4];
+	b03 = a[1]*a[6] - a[2]*a[5];
+	b04 = a[1]*a[7] - a[3]*a[5];
+	b05 = a[2]*a[7] - a[3]*a[6];
+	b06 = a[8]*a[13] - a[9]*a[12];
+	b07 = a[8]*a[14] - a[10]*a[12];
+	b08 = a[8]*a[15] - a[11]*a[12];
+	b09 = a[9]*a[14] - a[10]*a[13];
+	b10 = a[9]*a[15] - a[11]*a[13];
+	b11 = a[10]*a[15] - a[11]*a[14];
+
+	det = b00*b11 - b01*b10 + b02*b09 + b03*b08 - b04*b07 + b05*b06;
+	if(det == 0.0f) {
+		return 0;
+	}
+	det = 1.0f / det;
+
+	tmp[0] = (a[5]*b11 - a[6]*b10 + a[7]*b09) * det;
+	tmp[1] = (a[2]*b10 - a[1]*b11 - a[3]*b09) * det;
+	tmp[2] = (a[13]*b05 - a[14]*b04 + a[15]*b03) * det;
+	tmp[3] = (a[10]*b04 - a[9]*b05 - a[11]*b03) * det;
+	tmp[4] = (a[6]*b08 - a[4]*b11 - a[7]*b07) * det;
+	tmp[5] = (a[0]*b11 - a[2]*b08 + a[3]*b07) * det;
+	tmp[6] = (a[14]*b02 - a[12]*b05 - a[15]*b01) * det;
+	tmp[7] = (a[8]*b05 - a[10]*b02 + a[11]*b01) * det;
+	tmp[8] = (a[4]*b10 - a[5]*b08 + a[7]*b06) * det;
+	tmp[9] = (a[1]*b08 - a[0]*b10 - a[3]*b06) * det;
+	tmp[10] = (a[12]*b04 - a[13]*b02 + a[15]*b00) * det;
+	tmp[11] = (a[9]*b02 - a[8]*b04 - a[11]*b00) * det;
+	tmp[12] = (a[5]*b07 - a[4]*b09 - a[6]*b06) * det;
+	tmp[13] = (a[0]*b09 - a[1]*b07 + a[2]*b06) * det;
+	tmp[14] = (a[13]*b01 - a[12]*b03 - a[14]*b00) * det;
+	tmp[15] = (a[8]*b03 - a[9]*b01 + a[10]*b00) * det;
+
+	mat4_copy(tmp, m);
+	return 1;
+
+}
+
+/*
+ * The rows of the inverse of the upper 3x3 are the cross products of its
+ * columns divided by the determinant. Columns of the normal matrix are the
+ * same vectors.
+ */
+
+static int inverse_rows_scalar(mat4 a, vec3 x, vec3 y, vec3 z) {
+
+	float det;
+	vec3 c0 = { a[M_00], a[M_10], a[M_20] };
+	vec3 c1 = { a[M_01], a[M_11], a[M_21] };
+	vec3 c2 = { a[M_02], a[M_12], a[M_22] };
+
+	vec3_cross_multiply(c1, c2, x);
+	vec3_cross_multiply(c2, c0, y);
+	vec3_cross_multiply(c0, c1, z);
+
+	det = c0[0]*x[0] + c0[1]*x[1] + c0[2]*x[2];
+	if(det == 0.0f) {
+		return 0;
+	}
+	det = 1.0f / det;
+
+	x[0] *= det;
+	x[1] *= det;
+	x[2] *= det;
+	y[0] *= det;
+	y[1] *= det;
+	y[2] *= det;
+	z[0] *= det;
+	z[1] *= det;
+	z[2] *= det;
+
+	return 1;
+
+}
+
+static int mat4_inverse_affine_scalar(mat4 a, mat4 m) {
+
+	vec3 x, y, z, t;
+
+	if(!inverse_rows_scalar(a, x, y, z)) {
+		return 0;
+	}
+
+	t[0] = a[M_03];
+	t[1] = a[M_13];
+	t[2] = a[M_23];
+
+	m[M_00] = x[0];
+	m[M_01] = x[1];
+	m[M_02] = x[2];
+	m[M_03] = -(x[0]*t[0] + x[1]*t[1] + x[2]*t[2]);
+
+	m[M_10] = y[0];
+	m[M_11] = y[1];
+	m[M_12] = y[2];
+	m[M_13] = -(y[0]*t[0] + y[1]*t[1] + y[2]*t[2]);
+
+	m[M_20] = z[0];
+	m[M_21] = z[1];
+	m[M_22] = z[2];
+	m[M_23] = -(z[0]*t[0] + z[1]*t[1] + z[2]*t[2]);
+
+	m[M_30] = 0.0f;
+	m[M_31] = 0.0f;
+	m[M_32] = 0.0f;
+	m[M_33] = 1.0f;
+
+	return 1;
+
+}
+
+static void mat4_inverse_rigid_scalar(mat4 a, mat4 m) {
+
+	mat4 tmp;
+
+	tmp[M_00] = a[M_00];
+	tmp[M_01] = a[M_10];
+	tmp[M_02] = a[M_20];
+	tmp[M_10] = a[M_01];
+	tmp[M_11] = a[M_11];
+	tmp[M_12] = a[M_21];
+	tmp[M_20] = a[M_02];
+	tmp[M_21] = a[M_12];
+	tmp[M_22] = a[M_22];
+
+	tmp[M_03] = -(tmp[M_00]*a[M_03] + tmp[M_01]*a[M_13] + tmp[M_02]*a[M_23]);
+	tmp[M_13] = -(tmp[M_10]*a[M_03] + tmp[M_11]*a[M_13] + tmp[M_12]*a[M_23]);
+	tmp[M_23] = -(tmp[M_20]*a[M_03] + tmp[M_21]*a[M_13] + tmp[M_22]*a[M_23]);
+
+	tmp[M_30] = 0.0f;
+	tmp[M_31] = 0.0f;
+	tmp[M_32] = 0.0f;
+	tmp[M_33] = 1.0f;
+
+	mat4_copy(tmp, m);
+
+}
+
+static int mat3_normal_scalar(mat4 a, mat3 n) {
+
+	vec3 x, y, z;
+
+	if(!inverse_rows_scalar(a, x, y, z)) {
+		return 0;
+	}
+
+	n[0] = x[0];
+	n[1] = x[1];
+	n[2] = x[2];
+	n[3] = y[0];
+	n[4] = y[1];
+	n[5] = y[2];
+	n[6] = z[0];
+	n[7] = z[1];
+	n[8] = z[2];
+
+	return 1;
+
+}
+
+#ifdef DASH_X86
+
+#define SHUF(x, y, z, w) ((x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+#define SWIZZLE(v, x, y, z, w) _mm_shuffle_ps(v, v, SHUF(x, y, z, w))
+
+/* 2x2 row-major helpers: A * B, adj(A) * B and A * adj(B) */
+
+DASH_TARGET("sse2")
+static __m128 mat2_mul(__m128 a, __m128 b) {
+
+	return _mm_add_ps(
+		_mm_mul_ps(a, SWIZZLE(b, 0, 3, 0, 3)),
+		_mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1))
+	);
+
+}
+
+DASH_TARGET("sse2")
+static __m128 mat2_adj_mul(__m128 a, __m128 b) {
+
+	return _mm_sub_ps(
+		_mm_mul_ps(SWIZZLE(a, 3, 3, 0, 0), b),
+		_mm_mul_ps(SWIZZLE(a, 1, 1, 2, 2), SWIZZLE(b, 2, 3, 0, 1))
+	);
+
+}
+
+DASH_TARGET("sse2")
+static __m128 mat2_mul_adj(__m128 a, __m128 b) {
+
+	return _mm_sub_ps(
+		_mm_mul_ps(a, SWIZZLE(b, 3, 0, 3, 0)),
+		_mm_mul_ps(SWIZZLE(a, 1, 0, 3, 2), SWIZZLE(b, 2, 1, 2, 1))
+	);
+
+}
+
+DASH_TARGET("sse2")
+static __m128 hsum_sse2(__m128 v) {
+
+	v = _mm_add_ps(v, SWIZZLE(v, 2, 3, 0, 1));
+	return _mm_add_ps(v, SWIZZLE(v, 1, 0, 3, 2));
+
+}
+
+DASH_TARGET("sse2")
+static __m128 cross_sse2(__m128 a, __m128 b) {
+
+	return _mm_sub_ps(
+		_mm_mul_ps(SWIZZLE(a, 1, 2, 0, 3), SWIZZLE(b, 2, 0, 1, 3)),
+		_mm_mul_ps(SWIZZLE(a, 2, 0, 1, 3), SWIZZLE(b, 1, 2, 0, 3))
+	);
+
+}
+
+DASH_TARGET("sse2")
+static int mat4_inverse_sse2(mat4 a, mat4 m) {
+
+	__m128 r0, r1, r2, r3, A, B, C, D, det_sub, det_a, det_b, det_c, det_d;
+	__m128 d_c, a_b, x, y, z, w, det, tr;
+
+	r0 = _mm_loadu_ps(&a[0]);
+	r1 = _mm_loadu_ps(&a[4]);
+	r2 = _mm_loadu_ps(&a[8]);
+	r3 = _mm_loadu_ps(&a[12]);
+
+	A = _mm_movelh_ps(r0, r1);
+	B = _mm_movehl_ps(r1, r0);
+	C = _mm_movelh_ps(r2, r3);
+	D = _mm_movehl_ps(r3, r2);
+
+	det_sub = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, SHUF(0, 2, 0, 2)), _mm_shuffle_ps(r1, r3, SHUF(1, 3, 1, 3))),
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, SHUF(1, 3, 1, 3)), _mm_shuffle_ps(r1, r3, SHUF(0, 2, 0, 2)))
+	);
+	det_a = SWIZZLE(det_sub, 0, 0, 0, 0);
+	det_b = SWIZZLE(det_sub, 1, 1, 1, 1);
+	det_c = SWIZZLE(det_sub, 2, 2, 2, 2);
+	det_d = SWIZZLE(det_sub, 3, 3, 3, 3);
+
+	d_c = mat2_adj_mul(D, C);
+	a_b = mat2_adj_mul(A, B);
+	x = _mm_sub_ps(_mm_mul_ps(det_d, A), mat2_mul(B, d_c));
+	w = _mm_sub_ps(_mm_mul_ps(det_a, D), mat2_mul(C, a_b));
+	y = _mm_sub_ps(_mm_mul_ps(det_b, C), mat2_mul_adj(D, a_b));
+	z = _mm_sub_ps(_mm_mul_ps(det_c, B), mat2_mul_adj(A, d_c));
+
+	tr = hsum_sse2(_mm_mul_ps(a_b, SWIZZLE(d_c, 0, 2, 1, 3)));
+	det = _mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c));
+	det = _mm_sub_ps(det, tr);
+
+	if(_mm_cvtss_f32(det) == 0.0f) {
+		return 0;
+	}
+
+	det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+	x = _mm_mul_ps(x, det);
+	y = _mm_mul_ps(y, det);
+	z = _mm_mul_ps(z, det);
+	w = _mm_mul_ps(w, det);
+
+	_mm_storeu_ps(&m[0], _mm_shuffle_ps(x, y, SHUF(3, 1, 3, 1)));
+	_mm_storeu_ps(&m[4], _mm_shuffle_ps(x, y, SHUF(2, 0, 2, 0)));
+	_mm_storeu_ps(&m[8], _mm_shuffle_ps(z, w, SHUF(3, 1, 3, 1)));
+	_mm_storeu_ps(&m[12], _mm_shuffle_ps(z, w, SHUF(2, 0, 2, 0)));
+
+	return 1;
+
+}
+
+/*
+ * Loads the upper 3x3 columns with a zero w so the cross products and dot
+ * products below ignore the fourth lane.
+ */
+
+DASH_TARGET("sse2")
+static void load_columns_sse2(mat4 a, __m128 c[4]) {
+
+	__m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+
+	c[0] = _mm_and_ps(_mm_loadu_ps(&a[0]), mask);
+	c[1] = _mm_and_ps(_mm_loadu_ps(&a[4]), mask);
+	c[2] = _mm_and_ps(_mm_loadu_ps(&a[8]), mask);
+	c[3] = _mm_and_ps(_mm_loadu_ps(&a[12]), mask);
+
+}
+
+DASH_TARGET("sse2")
+static int inverse_rows_sse2(mat4 a, __m128 r[4]) {
+
+	__m128 c[4], det;
+
+	load_columns_sse2(a, c);
+
+	r[0] = cross_sse2(c[1], c[2]);
+	r[1] = cross_sse2(c[2], c[0]);
+	r[2] = cross_sse2(c[0], c[1]);
+	r[3] = c[3];
+
+	det = hsum_sse2(_mm_mul_ps(c[0], r[0]));
+	if(_mm_cvtss_f32(det) == 0.0f) {
+		return 0;
+	}
+
+	det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+	r[0] = _mm_mul_ps(r[0], det);
+	r[1] = _mm_mul_ps(r[1], det);
+	r[2] = _mm_mul_ps(r[2], det);
+
+	return 1;
+
+}
+
+/*
+ * Given the columns of the inverted 3x3 (w = 0) and the original
+ * translation, writes the inverse translation column and stores m.
+ */
+
+DASH_TARGET("sse2")
+static void store_inverse_sse2(__m128 c0, __m128 c1, __m128 c2, __m128 t, mat4 m) {
+
+	__m128 res;
+
+	res = _mm_add_ps(
+		_mm_mul_ps(c0, SWIZZLE(t, 0, 0, 0, 0)),
+		_mm_mul_ps(c1, SWIZZLE(t, 1, 1, 1, 1))
+	);
+	res = _mm_add_ps(res, _mm_mul_ps(c2, SWIZZLE(t, 2, 2, 2, 2)));
+	res = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), res);
+
+	_mm_storeu_ps(&m[0], c0);
+	_mm_storeu_ps(&m[4], c1);
+	_mm_storeu_ps(&m[8], c2);
+	_mm_storeu_ps(&m[12], res);
+
+}
+
+DASH_TARGET("sse2")
+static int mat4_inverse_affine_sse2(mat4 a, mat4 m) {
+
+	__m128 r[4], zero;
+
+	if(!inverse_rows_sse2(a, r)) {
+		return 0;
+	}
+
+	zero = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(r[0], r[1], r[2], zero);
+	store_inverse_sse2(r[0], r[1], r[2], r[3], m);
+
+	return 1;
+
+}
+
+DASH_TARGET("sse2")
+static void mat4_inverse_rigid_sse2(mat4 a, mat4 m) {
+
+	__m128 c[4], zero;
+
+	load_columns_sse2(a, c);
+	zero = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(c[0], c[1], c[2], zero);
+	store_inverse_sse2(c[0], c[1], c[2], c[3], m);
+
+}
+
+DASH_TARGET("sse2")
+static int mat3_normal_sse2(mat4 a, mat3 n) {
+
+	float tail[4];
+	__m128 r[4];
+
+	if(!inverse_rows_sse2(a, r)) {
+		return 0;
+	}
+
+	// Overlapping stores, each one overwrites the previous w lane
+	_mm_storeu_ps(&n[0], r[0]);
+	_mm_storeu_ps(&n[3], r[1]);
+	_mm_storeu_ps(tail, r[2]);
+	n[6] = tail[0];
+	n[7] = tail[1];
+	n[8] = tail[2];
+
+	return 1;
+
+}
+
+#endif
+
+/*
+ * Culling kernels test bounding volumes stored as structure-of-arrays
+ * against the six frustum planes, 4 or 8 volumes per instruction, and append
+ * the index of every volume that is not fully outside a plane to visible.
+ * They return the number of indices written.
+ */
+
+static int cull_spheres_from(frustum f, vec3_soa c, float *r, int first, int count, int *visible) {
+
+	int i, p, n;
+	float d;
+
+	n = 0;
+	for(i = first; i < count; i++) {
+		for(p = 0; p < 6; p++) {
+			d = f[p][0]*c.x[i] + f[p][1]*c.y[i] + f[p][2]*c.z[i] + f[p][3];
+			if(d < -r[i]) {
+				break;
+			}
+		}
+		if(p == 6) {
+			visible[n++] = i;
+		}
+	}
+
+	return n;
+
+}
+
+static int cull_aabbs_from(frustum f, vec3_soa lo, vec3_soa hi, int first, int count, int *visible) {
+
+	int i, p, n;
+	float cx, cy, cz, ex, ey, ez, d;
+
+	n = 0;
+	for(i = first; i < count; i++) {
+		cx = (lo.x[i] + hi.x[i]) * 0.5f;
+		cy = (lo.y[i] + hi.y[i]) * 0.5f;
+		cz = (lo.z[i] + hi.z[i]) * 0.5f;
+		ex = (hi.x[i] - lo.x[i]) * 0.5f;
+		ey = (hi.y[i] - lo.y[i]) * 0.5f;
+		ez = (hi.z[i] - lo.z[i]) * 0.5f;
+		for(p = 0; p < 6; p++) {
+			d = f[p][0]*cx + f[p][1]*cy + f[p][2]*cz + f[p][3];
+			d += fabsf(f[p][0])*ex + fabsf(f[p][1])*ey + fabsf(f[p][2])*ez;
+			if(d < 0.0f) {
+				break;
+			}
+		}
+		if(p == 6) {
+			visible[n++] = i;
+		}
+	}
+
+	return n;
+
+}
+
+static int cull_spheres_scalar(frustum f, vec3_soa c, float *r, int count, int *visible) {
+
+	return cull_spheres_from(f, c, r, 0, count, visible);
+
+}
+
+static int cull_aabbs_scalar(frustum f, vec3_soa lo, vec3_soa hi, int count, int *visible) {
+
+	return cull_aabbs_from(f, lo, hi, 0, count, visible);
+
+}
+
+#ifdef DASH_X86
+
+static int append_mask(int mask, int first, int *visible) {
+
+	int n = 0;
+
+	while(mask) {
+		visible[n++] = first + __builtin_ctz(mask);
+		mask &= mask - 1;
+	}
+
+	return n;
+
+}
+
+DASH_TARGET("sse2")
+static int cull_spheres_sse2(frustum f, vec3_soa c, float *r, int count, int *visible) {
+
+	int i, p, n;
+	__m128 x, y, z, rad, d, inside;
+
+	n = 0;
+	for(i = 0; i + 4 <= count; i += 4) {
+
+		x = _mm_loadu_ps(&c.x[i]);
+		y = _mm_loadu_ps(&c.y[i]);
+		z = _mm_loadu_ps(&c.z[i]);
+		rad = _mm_loadu_ps(&r[i]);
+		inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for(p = 0; p < 6; p++) {
+			d = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(f[p][0])), _mm_mul_ps(y, _mm_set1_ps(f[p][1])));
+			d = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(f[p][2])));
+			d = _mm_add_ps(d, _mm_add_ps(rad, _mm_set1_ps(f[p][3])));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+		}
+
+		n += append_mask(_mm_movemask_ps(inside), i, visible + n);
+
+	}
+
+	return n + cull_spheres_from(f, c, r, i, count, visible + n);
+
+}
+
+DASH_TARGET("sse2")
+static int cull_aabbs_sse2(frustum f, vec3_soa lo, vec3_soa hi, int count, int *visible) {
+
+	int i, p, n;
+	__m128 cx, cy, cz, ex, ey, ez, half, d, inside;
+
+	half = _mm_set1_ps(0.5f);
+
+	n = 0;
+	for(i = 0; i + 4 <= count; i += 4) {
+
+		cx = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&lo.x[i]), _mm_loadu_ps(&hi.x[i])), half);
+		cy = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&lo.y[i]), _mm_loadu_ps(&hi.y[i])), half);
+		cz = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&lo.z[i]), _mm_loadu_ps(&hi.z[i])), half);
+		ex = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&hi.x[i]), _mm_loadu_ps(&lo.x[i])), half);
+		ey = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&hi.y[i]), _mm_loadu_ps(&lo.y[i])), half);
+		ez = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&hi.z[i]), _mm_loadu_ps(&lo.z[i])), half);
+		inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for(p = 0; p < 6; p++) {
+			d = _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(f[p][0])), _mm_mul_ps(cy, _mm_set1_ps(f[p][1])));
+			d = _mm_add_ps(d, _mm_mul_ps(cz, _mm_set1_ps(f[p][2])));
+			d = _mm_add_ps(d, _mm_set1_ps(f[p][3]));
+			d = _mm_add_ps(d, _mm_mul_ps(ex, _mm_set1_ps(fabsf(f[p][0]))));
+			d = _mm_add_ps(d, _mm_mul_ps(ey, _mm_set1_ps(fabsf(f[p][1]))));
+			d = _mm_add_ps(d, _mm_mul_ps(ez, _mm_set1_ps(fabsf(f[p][2]))));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+		}
+
+		n += append_mask(_mm_movemask_ps(inside), i, visible + n);
+
+	}
+
+	return n + cull_aabbs_from(f, lo, hi, i, count, visible + n);
+
+}
+
+DASH_TARGET("avx2,fma")
+static int cull_spheres_avx2(frustum f, vec3_soa c, float *r, int count, int *visible) {
+
+	int i, p, n;
+	__m256 x, y, z, rad, d, inside;
+
+	n = 0;
+	for(i = 0; i + 8 <= count; i += 8) {
+
+		x = _mm256_loadu_ps(&c.x[i]);
+		y = _mm256_loadu_ps(&c.y[i]);
+		z = _mm256_loadu_ps(&c.z[i]);
+		rad = _mm256_loadu_ps(&r[i]);
+		inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		for(p = 0; p < 6; p++) {
+			d = _mm256_add_ps(rad, _mm256_set1_ps(f[p][3]));
+			d = _mm256_fmadd_ps(x, _mm256_set1_ps(f[p][0]), d);
+			d = _mm256_fmadd_ps(y, _mm256_set1_ps(f[p][1]), d);
+			d = _mm256_fmadd_ps(z, _mm256_set1_ps(f[p][2]), d);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		n += append_mask(_mm256_movemask_ps(inside), i, visible + n);
+
+	}
+
+	return n + cull_spheres_from(f, c, r, i, count, visible + n);
+
+}
+
+DASH_TARGET("avx2,fma")
+static int cull_aabbs_avx2(frustum f, vec3_soa lo, vec3_soa hi, int count, int *visible) {
+
+	int i, p, n;
+	__m256 cx, cy, cz, ex, ey, ez, half, d, inside;
+
+	half = _mm256_set1_ps(0.5f);
+
+	n = 0;
+	for(i = 0; i + 8 <= count; i += 8) {
+
+		cx = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(&lo.x[i]), _mm256_loadu_ps(&hi.x[i])), half);
+		cy = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(&lo.y[i]), _mm256_loadu_ps(&hi.y[i])), half);
+		cz = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(&lo.z[i]), _mm256_loadu_ps(&hi.z[i])), half);
+		ex = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&hi.x[i]), _mm256_loadu_ps(&lo.x[i])), half);
+		ey = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&hi.y[i]), _mm256_loadu_ps(&lo.y[i])), half);
+		ez = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&hi.z[i]), _mm256_loadu_ps(&lo.z[i])), half);
+		inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		for(p = 0; p < 6; p++) {
+			d = _mm256_set1_ps(f[p][3]);
+			d = _mm256_fmadd_ps(cx, _mm256_set1_ps(f[p][0]), d);
+			d = _mm256_fmadd_ps(cy, _mm256_set1_ps(f[p][1]), d);
+			d = _mm256_fmadd_ps(cz, _mm256_set1_ps(f[p][2]), d);
+			d = _mm256_fmadd_ps(ex, _mm256_set1_ps(fabsf(f[p][0])), d);
+			d = _mm256_fmadd_ps(ey, _mm256_set1_ps(fabsf(f[p][1])), d);
+			d = _mm256_fmadd_ps(ez, _mm256_set1_ps(fabsf(f[p][2])), d);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		n += append_mask(_mm256_movemask_ps(inside), i, visible + n);
+
+	}
+
+	return n + cull_aabbs_from(f, lo, hi, i, count, visible + n);
+
+}
+
+#endif
+
+/*
+ * Vertex format kernels convert as many values as fit whole vectors and
+ * return how many they handled; the caller converts the tail with the
+ * scalar functions. Every path rounds to nearest even, as cvtps and F16C do,
+ * so results are bit-identical to the scalar conversions.
+ */
+
+#ifdef DASH_X86
+
+// Branchless float to half with round to nearest even (after F. Giesen)
+DASH_TARGET("sse2")
+static __m128i half_encode4_sse2(__m128 f) {
+
+	__m128i sign, abs_i, is_regular, is_sub, inf_or_nan, sub, odd, normal, out;
+	__m128 abs_f, is_nan;
+
+	sign = _mm_and_si128(_mm_castps_si128(f), _mm_set1_epi32(0x80000000));
+	abs_i = _mm_xor_si128(_mm_castps_si128(f), sign);
+	abs_f = _mm_castsi128_ps(abs_i);
+
+	is_nan = _mm_cmpunord_ps(abs_f, abs_f);
+	is_regular = _mm_cmpgt_epi32(_mm_set1_epi32((127 + 16) << 23), abs_i);
+	is_sub = _mm_cmpgt_epi32(_mm_set1_epi32((127 - 14) << 23), abs_i);
+	inf_or_nan = _mm_or_si128(
+		_mm_and_si128(_mm_castps_si128(is_nan), _mm_set1_epi32(0x200)),
+		_mm_set1_epi32(0x7c00)
+	);
+
+	// Subnormal results: let the FPU align the mantissa by adding a magic
+	sub = _mm_castps_si128(_mm_add_ps(abs_f, _mm_castsi128_ps(_mm_set1_epi32(126 << 23))));
+	sub = _mm_sub_epi32(sub, _mm_set1_epi32(126 << 23));
+
+	// Normal results: rebias the exponent and round on the dropped 13 bits
+	odd = _mm_srai_epi32(_mm_slli_epi32(abs_i, 18), 31);
+	normal = _mm_add_epi32(abs_i, _mm_set1_epi32(0xfff - ((127 - 15) << 23)));
+	normal = _mm_srli_epi32(_mm_sub_epi32(normal, odd), 13);
+
+	out = _mm_or_si128(_mm_and_si128(is_sub, sub), _mm_andnot_si128(is_sub, normal));
+	out = _mm_or_si128(_mm_and_si128(is_regular, out), _mm_andnot_si128(is_regular, inf_or_nan));
+
+	return _mm_or_si128(out, _mm_srai_epi32(sign, 16));
+
+}
+
+DASH_TARGET("sse2")
+static __m128 half_decode4_sse2(__m128i h) {
+
+	__m128i exp_mant, sign, was_inf_nan;
+	__m128 scaled;
+
+	exp_mant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+	sign = _mm_slli_epi32(_mm_xor_si128(h, exp_mant), 16);
+
+	scaled = _mm_mul_ps(
+		_mm_castsi128_ps(_mm_slli_epi32(exp_mant, 13)),
+		_mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23))
+	);
+
+	was_inf_nan = _mm_cmpgt_epi32(exp_mant, _mm_set1_epi32(0x7bff));
+	was_inf_nan = _mm_and_si128(was_inf_nan, _mm_set1_epi32(255 << 23));
+
+	return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, was_inf_nan)));
+
+}
+
+DASH_TARGET("sse2")
+static int half_encode_sse2(const float *src, unsigned short *dst, int count) {
+
+	int i;
+	__m128i lo, hi;
+
+	for(i = 0; i + 8 <= count; i += 8) {
+		lo = half_encode4_sse2(_mm_loadu_ps(&src[i]));
+		hi = half_encode4_sse2(_mm_loadu_ps(&src[i + 4]));
+		_mm_storeu_si128((__m128i*)&dst[i], _mm_packs_epi32(lo, hi));
+	}
+
+	return i;
+
+}
+
+DASH_TARGET("sse2")
+static int half_decode_sse2(const unsigned short *src, float *dst, int count) {
+
+	int i;
+	__m128i h;
+
+	for(i = 0; i + 8 <= count; i += 8) {
+		h = _mm_loadu_si128((const __m128i*)&src[i]);
+		_mm_storeu_ps(&dst[i], half_decode4_sse2(_mm_unpacklo_epi16(h, _mm_setzero_si128())));
+		_mm_storeu_ps(&dst[i + 4], half_decode4_sse2(_mm_unpackhi_epi16(h, _mm_setzero_si128())));
+	}
+
+	return i;
+
+}
+
+DASH_TARGET("avx,f16c")
+static int half_encode_f16c(const float *src, unsigned short *dst, int count) {
+
+	int i;
+
+	for(i = 0; i + 8 <= count; i += 8) {
+		_mm_storeu_si128(
+			(__m128i*)&dst[i],
+			_mm256_cvtps_ph(_mm256_loadu_ps(&src[i]), _MM_FROUND_TO_NEAREST_INT)
+		);
+	}
+
+	return i;
+
+}
+
+DASH_TARGET("avx,f16c")
+static int half_decode_f16c(const unsigned short *src, float *dst, int count) {
+
+	int i;
+
+	for(i = 0; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(&dst[i], _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)&src[i])));
+	}
+
+	return i;
+
+}
+
+// Clamps to [lo, 1] (NaN becomes lo) and scales to the integer range
+DASH_TARGET("sse2")
+static __m128i norm4_sse2(__m128 f, float lo, float scale) {
+
+	f = _mm_max_ps(f, _mm_set1_ps(lo));
+	f = _mm_min_ps(f, _mm_set1_ps(1.0f));
+	return _mm_cvtps_epi32(_mm_mul_ps(f, _mm_set1_ps(scale)));
+
+}
+
+DASH_TARGET("sse2")
+static int norm16_sse2(const float *src, short *dst, int count, int is_signed) {
+
+	int i;
+	__m128i lo, hi, bias;
+
+	bias = _mm_set1_epi32(is_signed ? 0 : 32768);
+
+	for(i = 0; i + 8 <= count; i += 8) {
+		if(is_signed) {
+			lo = norm4_sse2(_mm_loadu_ps(&src[i]), -1.0f, 32767.0f);
+			hi = norm4_sse2(_mm_loadu_ps(&src[i + 4]), -1.0f, 32767.0f);
+		} else {
+			// SSE2 only packs with signed saturation, so shift into range
+			lo = _mm_sub_epi32(norm4_sse2(_mm_loadu_ps(&src[i]), 0.0f, 65535.0f), bias);
+			hi = _mm_sub_epi32(norm4_sse2(_mm_loadu_ps(&src[i + 4]), 0.0f, 65535.0f), bias);
+		}
+		lo = _mm_packs_epi32(lo, hi);
+		if(!is_signed) {
+			lo = _mm_xor_si128(lo, _mm_set1_epi16((short)0x8000));
+		}
+		_mm_storeu_si128((__m128i*)&dst[i], lo);
+	}
+
+	return i;
+
+}
+
+DASH_TARGET("sse2")
+static int norm8_sse2(const float *src, signed char *dst, int count, int is_signed) {
+
+	int i, j;
+	float lo, scale;
+	__m128i v[4], a, b;
+
+	lo = is_signed ? -1.0f : 0.0f;
+	scale = is_signed ? 127.0f : 255.0f;
+
+	for(i = 0; i + 16 <= count; i += 16) {
+		for(j = 0; j < 4; j++) {
+			v[j] = norm4_sse2(_mm_loadu_ps(&src[i + j*4]), lo, scale);
+		}
+		a = _mm_packs_epi32(v[0], v[1]);
+		b = _mm_packs_epi32(v[2], v[3]);
+		a = is_signed ? _mm_packs_epi16(a, b) : _mm_packus_epi16(a, b);
+		_mm_storeu_si128((__m128i*)&dst[i], a);
+	}
+
+	return i;
+
+}
+
+// Transposes four xyzw inputs so each component shifts by a constant
+DASH_TARGET("sse2")
+static int pack_2_10_10_10_sse2(const float *src, unsigned int *dst, int count, int is_signed) {
+
+	int i;
+	float lo, scale, scale_w;
+	__m128 x, y, z, w;
+	__m128i mask, out;
+
+	lo = is_signed ? -1.0f : 0.0f;
+	scale = is_signed ? 511.0f : 1023.0f;
+	scale_w = is_signed ? 1.0f : 3.0f;
+	mask = _mm_set1_epi32(0x3ff);
+
+	for(i = 0; i + 4 <= count; i += 4) {
+		x = _mm_loadu_ps(&src[i*4]);
+		y = _mm_loadu_ps(&src[i*4 + 4]);
+		z = _mm_loadu_ps(&src[i*4 + 8]);
+		w = _mm_loadu_ps(&src[i*4 + 12]);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		out = _mm_and_si128(norm4_sse2(x, lo, scale), mask);
+		out = _mm_or_si128(out, _mm_slli_epi32(_mm_and_si128(norm4_sse2(y, lo, scale), mask), 10));
+		out = _mm_or_si128(out, _mm_slli_epi32(_mm_and_si128(norm4_sse2(z, lo, scale), mask), 20));
+		out = _mm_or_si128(out, _mm_slli_epi32(norm4_sse2(w, lo, scale_w), 30));
+		_mm_storeu_si128((__m128i*)&dst[i], out);
+	}
+
+	return i;
+
+}
+
+// 2x2 box of two rows of four RGBA8 pixels, as two pixels in 16-bit lanes
+DASH_TARGET("sse2")
+static inline __m128i box4_sse2(__m128i a, __m128i b) {
+
+	__m128i zero, lo, hi, sum;
+
+	zero = _mm_setzero_si128();
+	lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+	hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+	sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+
+}
+
+// Four output pixels per step, needs 2 * count source pixels in each row
+DASH_TARGET("sse2")
+static int downsample_rgba_sse2(const unsigned char *r0, const unsigned char *r1, unsigned char *dst, int count) {
+
+	int i;
+	__m128i lo, hi;
+
+	for(i = 0; i + 4 <= count; i += 4) {
+		lo = box4_sse2(
+			_mm_loadu_si128((const __m128i*)&r0[i*8]),
+			_mm_loadu_si128((const __m128i*)&r1[i*8])
+		);
+		hi = box4_sse2(
+			_mm_loadu_si128((const __m128i*)&r0[i*8 + 16]),
+			_mm_loadu_si128((const __m128i*)&r1[i*8 + 16])
+		);
+		_mm_storeu_si128((__m128i*)&dst[i*4], _mm_packus_epi16(lo, hi));
+	}
+
+	return i;
+
+}
+
+// Premultiply and red/blue swap of four RGBA8 pixels per step in 16-bit
+// lanes, rounding c * a / 255 exactly the way the scalar loop does
+DASH_TARGET("sse2")
+static int transform_rgba_sse2(unsigned char *p, int count, int flags) {
+
+	int i, k;
+	__m128i zero, v, px[2], a, keep, opaque;
+
+	zero = _mm_setzero_si128();
+	keep = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	opaque = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+	for(i = 0; i + 4 <= count; i += 4) {
+		v = _mm_loadu_si128((const __m128i*)&p[i*4]);
+		px[0] = _mm_unpacklo_epi8(v, zero);
+		px[1] = _mm_unpackhi_epi8(v, zero);
+
+		for(k = 0; k < 2; k++) {
+			if(flags & DASH_IMAGE_PREMULTIPLY) {
+				// Alpha scales itself by 255, which leaves it unchanged
+				a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px[k], 0xFF), 0xFF);
+				a = _mm_or_si128(_mm_and_si128(a, keep), opaque);
+				px[k] = _mm_add_epi16(_mm_mullo_epi16(px[k], a), _mm_set1_epi16(128));
+				px[k] = _mm_srli_epi16(_mm_add_epi16(px[k], _mm_srli_epi16(px[k], 8)), 8);
+			}
+			if(flags & DASH_IMAGE_SWAP_RB) {
+				px[k] = _mm_shufflelo_epi16(px[k], _MM_SHUFFLE(3, 0, 1, 2));
+				px[k] = _mm_shufflehi_epi16(px[k], _MM_SHUFFLE(3, 0, 1, 2));
+			}
+		}
+
+		_mm_storeu_si128((__m128i*)&p[i*4], _mm_packus_epi16(px[0], px[1]));
+	}
+
+	return i;
+
+}
+
+#endif
+
+/*
+ * Scalar counterparts of the quaternion batch kernels.
+ */
+
+static int quat_multiply_scalar(quat *a, quat *b, quat *q, int count) {
+
+	int i;
+
+	for(i = 0; i < count; i++) {
+		quat_multiply(a[i], b[i], q[i]);
+	}
+
+	return count;
+
+}
+
+static int quat_normalize_scalar(quat *a, quat *q, int count) {
+
+	int i;
+
+	for(i = 0; i < count; i++) {
+		quat_normalize(a[i], q[i]);
+	}
+
+	return count;
+
+}
+
+static int quat_nlerp_scalar(quat *a, quat *b, float *t, quat *q, int count) {
+
+	int i;
+
+	for(i = 0; i < count; i++) {
+		quat_nlerp(a[i], b[i], t[i], q[i]);
+	}
+
+	return count;
+
+}
+
+static int quat_slerp_scalar(quat *a, quat *b, float *t, quat *q, int count) {
+
+	int i;
+
+	for(i = 0; i < count; i++) {
+		quat_slerp(a[i], b[i], t[i], q[i]);
+	}
+
+	return count;
+
+}
+
+static int mat4_from_quat_scalar(quat *q, mat4 *m, int count) {
+
+	int i;
+
+	for(i = 0; i < count; i++) {
+		mat4_from_quat(q[i], m[i]);
+	}
+
+	return count;
+
+}
+
+static int dquat_multiply_scalar(dquat *a, dquat *b, dquat *d, int count) {
+
+	int i;
+
+	for(i = 0; i < count; i++) {
+		dquat_multiply(a[i], b[i], d[i]);
+	}
+
+	return count;
+
+}
+
+static int dquat_nlerp_scalar(dquat *a, dquat *b, float *t, dquat *d, int count) {
+
+	int i;
+
+	for(i = 0; i < count; i++) {
+		dquat_nlerp(a[i], b[i], t[i], d[i]);
+	}
+
+	return count;
+
+}
+
+static int mat4_from_dquat_scalar(dquat *d, mat4 *m, int count) {
+
+	int i;
+
+	for(i = 0; i < count; i++) {
+		mat4_from_dquat(d[i], m[i]);
+	}
+
+	return count;
+
+}
+
+/*
+ * The conversion kernels return how many elements they handled; the batch
+ * functions finish the rest one element at a time.
+ */
+
+static int half_encode_scalar(const float *src, unsigned short *dst, int count) {
+
+	int i;
+
+	for(i = 0; i < count; i++) {
+		dst[i] = dash_float_to_half(src[i]);
+	}
+
+	return count;
+
+}
+
+static int half_decode_scalar(const unsigned short *src, float *dst, int count) {
+
+	int i;
+
+	for(i = 0; i < count; i++) {
+		dst[i] = dash_half_to_float(src[i]);
+	}
+
+	return count;
+
+}
+
+static int norm16_scalar(const float *src, short *dst, int count, int is_signed) {
+
+	int i;
+
+	for(i = 0; i < count; i++) {
+		dst[i] = is_signed ? dash_float_to_snorm16(src[i]) : (short)dash_float_to_unorm16(src[i]);
+	}
+
+	return count;
+
+}
+
+static int norm8_scalar(const float *src, signed char *dst, int count, int is_signed) {
+
+	int i;
+
+	for(i = 0; i < count; i++) {
+		dst[i] = is_signed ? dash_float_to_snorm8(src[i]) : (signed char)dash_float_to_unorm8(src[i]);
+	}
+
+	return count;
+
+}
+
+static int pack_2_10_10_10_scalar(const float *src, unsigned int *dst, int count, int is_signed) {
+
+	int i;
+	const float *v;
+
+	for(i = 0; i < count; i++) {
+		v = &src[i*4];
+		dst[i] = is_signed ?
+			dash_pack_snorm_2_10_10_10(v[0], v[1], v[2], v[3]) :
+			dash_pack_unorm_2_10_10_10(v[0], v[1], v[2], v[3]);
+	}
+
+	return count;
+
+}
+
+/*
+ * RGBA8 row kernels for dash_image_downsample and dash_image_transform,
+ * which also run on the texture stream threads. Like the conversions they
+ * return how many pixels they handled.
+ */
+
+static int downsample_rgba_scalar(const unsigned char *r0, const unsigned char *r1, unsigned char *dst, int count) {
+
+	int i, c;
+
+	for(i = 0; i < count; i++) {
+		for(c = 0; c < 4; c++) {
+			dst[i*4 + c] = (unsigned char)((r0[i*8 + c] + r0[i*8 + 4 + c] + r1[i*8 + c] + r1[i*8 + 4 + c] + 2) >> 2);
+		}
+	}
+
+	return count;
+
+}
+
+static int transform_rgba_scalar(unsigned char *p, int count, int flags) {
+
+	int i, c, t;
+	unsigned char swap;
+
+	for(i = 0; i < count; i++) {
+		if(flags & DASH_IMAGE_PREMULTIPLY) {
+			for(c = 0; c < 3; c++) {
+				t = p[i*4 + c] * p[i*4 + 3] + 128;
+				p[i*4 + c] = (unsigned char)((t + (t >> 8)) >> 8);
+			}
+		}
+		if(flags & DASH_IMAGE_SWAP_RB) {
+			swap = p[i*4];
+			p[i*4] = p[i*4 + 2];
+			p[i*4 + 2] = swap;
+		}
+	}
+
+	return count;
+
+}
+
+static void mat4_multiply_select(mat4 a, mat4 b, mat4 m);
+static void compose_block_select(float b[BATCH_ROWS][DASH_BATCH], mat4 *m, int n);
+static void sincos_poly_select(const float *x, float *s, float *c, int count);
+static int mat4_inverse_select(mat4 a, mat4 m);
+static int mat4_inverse_affine_select(mat4 a, mat4 m);
+static void mat4_inverse_rigid_select(mat4 a, mat4 m);
+static int mat3_normal_select(mat4 a, mat3 n);
+static int cull_spheres_select(frustum f, vec3_soa c, float *r, int count, int *visible);
+static int cull_aabbs_select(frustum f, vec3_soa lo, vec3_soa hi, int count, int *visible);
+static int quat_multiply_select(quat *a, quat *b, quat *q, int count);
+static int quat_normalize_select(quat *a, quat *q, int count);
+static int quat_nlerp_select(quat *a, quat *b, float *t, quat *q, int count);
+static int quat_slerp_select(quat *a, quat *b, float *t, quat *q, int count);
+static int mat4_from_quat_select(quat *q, mat4 *m, int count);
+static int dquat_multiply_select(dquat *a, dquat *b, dquat *d, int count);
+static int dquat_nlerp_select(dquat *a, dquat *b, float *t, dquat *d, int count);
+static int mat4_from_dquat_select(dquat *d, mat4 *m, int count);
+static int half_encode_select(const float *src, unsigned short *dst, int count);
+static int half_decode_select(const unsigned short *src, float *dst, int count);
+static int norm16_select(const float *src, short *dst, int count, int is_signed);
+static int norm8_select(const float *src, signed char *dst, int count, int is_signed);
+static int pack_2_10_10_10_select(const float *src, unsigned int *dst, int count, int is_signed);
+static int downsample_rgba_select(const unsigned char *r0, const unsigned char *r1, unsigned char *dst, int count);
+static int transform_rgba_select(unsigned char *p, int count, int flags);
+
+static void (*mat4_multiply_kernel)(mat4, mat4, mat4) = mat4_multiply_select;
+static void (*compose_block_kernel)(float [BATCH_ROWS][DASH_BATCH], mat4*, int) = compose_block_select;
+static void (*sincos_poly_kernel)(const float*, float*, float*, int) = sincos_poly_select;
+static int (*mat4_inverse_kernel)(mat4, mat4) = mat4_inverse_select;
+static int (*mat4_inverse_affine_kernel)(mat4, mat4) = mat4_inverse_affine_select;
+static void (*mat4_inverse_rigid_kernel)(mat4, mat4) = mat4_inverse_rigid_select;
+static int (*mat3_normal_kernel)(mat4, mat3) = mat3_normal_select;
+static int (*cull_spheres_kernel)(frustum, vec3_soa, float*, int, int*) = cull_spheres_select;
+static int (*cull_aabbs_kernel)(frustum, vec3_soa, vec3_soa, int, int*) = cull_aabbs_select;
+static int (*quat_multiply_kernel)(quat*, quat*, quat*, int) = quat_multiply_select;
+static int (*quat_normalize_kernel)(quat*, quat*, int) = quat_normalize_select;
+static int (*quat_nlerp_kernel)(quat*, quat*, float*, quat*, int) = quat_nlerp_select;
+static int (*quat_slerp_kernel)(quat*, quat*, float*, quat*, int) = quat_slerp_select;
+static int (*mat4_from_quat_kernel)(quat*, mat4*, int) = mat4_from_quat_select;
+static int (*dquat_multiply_kernel)(dquat*, dquat*, dquat*, int) = dquat_multiply_select;
+static int (*dquat_nlerp_kernel)(dquat*, dquat*, float*, dquat*, int) = dquat_nlerp_select;
+static int (*mat4_from_dquat_kernel)(dquat*, mat4*, int) = mat4_from_dquat_select;
+static int (*half_encode_kernel)(const float*, unsigned short*, int) = half_encode_select;
+static int (*half_decode_kernel)(const unsigned short*, float*, int) = half_decode_select;
+static int (*norm16_kernel)(const float*, short*, int, int) = norm16_select;
+static int (*norm8_kernel)(const float*, signed char*, int, int) = norm8_select;
+static int (*pack_2_10_10_10_kernel)(const float*, unsigned int*, int, int) = pack_2_10_10_10_select;
+static int (*downsample_rgba_kernel)(const unsigned char*, const unsigned char*, unsigned char*, int) = downsample_rgba_select;
+static int (*transform_rgba_kernel)(unsigned char*, int, int) = transform_rgba_select;
+
+static void simd_select() {
+
+	int features = dash_cpu_features();
+
+	mat4_multiply_kernel = mat4_multiply_scalar;
+	compose_block_kernel = compose_block_scalar;
+	sincos_poly_kernel = sincos_poly_scalar;
+	mat4_inverse_kernel = mat4_inverse_scalar;
+	mat4_inverse_affine_kernel = mat4_inverse_affine_scalar;
+	mat4_inverse_rigid_kernel = mat4_inverse_rigid_scalar;
+	mat3_normal_kernel = mat3_normal_scalar;
+	cull_spheres_kernel = cull_spheres_scalar;
+	cull_aabbs_kernel = cull_aabbs_scalar;
+	quat_multiply_kernel = quat_multiply_scalar;
+	quat_normalize_kernel = quat_normalize_scalar;
+	quat_nlerp_kernel = quat_nlerp_scalar;
+	quat_slerp_kernel = quat_slerp_scalar;
+	mat4_from_quat_kernel = mat4_from_quat_scalar;
+	dquat_multiply_kernel = dquat_multiply_scalar;
+	dquat_nlerp_kernel = dquat_nlerp_scalar;
+	mat4_from_dquat_kernel = mat4_from_dquat_scalar;
+	half_encode_kernel = half_encode_scalar;
+	half_decode_kernel = half_decode_scalar;
+	norm16_kernel = norm16_scalar;
+	norm8_kernel = norm8_scalar;
+	pack_2_10_10_10_kernel = pack_2_10_10_10_scalar;
+	downsample_rgba_kernel = downsample_rgba_scalar;
+	transform_rgba_kernel = transform_rgba_scalar;
+
+	#ifdef DASH_X86
+	if(features & DASH_CPU_AVX2) {
+		mat4_multiply_kernel = mat4_multiply_avx2;
+		compose_block_kernel = compose_block_avx2;
+		sincos_poly_kernel = sincos_poly_avx2;
+		cull_spheres_kernel = cull_spheres_avx2;
+		cull_aabbs_kernel = cull_aabbs_avx2;
+	} else if(features & DASH_CPU_SSE2) {
+		mat4_multiply_kernel = mat4_multiply_sse2;
+		compose_block_kernel = compose_block_sse2;
+		sincos_poly_kernel = sincos_poly_sse2;
+		cull_spheres_kernel = cull_spheres_sse2;
+		cull_aabbs_kernel = cull_aabbs_sse2;
+	}
+
+	if(features & DASH_CPU_F16C) {
+		half_encode_kernel = half_encode_f16c;
+		half_decode_kernel = half_decode_f16c;
+	} else if(features & DASH_CPU_SSE2) {
+		half_encode_kernel = half_encode_sse2;
+		half_decode_kernel = half_decode_sse2;
+	}
+
+	if(features & DASH_CPU_SSE2) {
+		mat4_inverse_kernel = mat4_inverse_sse2;
+		mat4_inverse_affine_kernel = mat4_inverse_affine_sse2;
+		mat4_inverse_rigid_kernel = mat4_inverse_rigid_sse2;
+		mat3_normal_kernel = mat3_normal_sse2;
+		quat_multiply_kernel = quat_multiply_sse2;
+		quat_normalize_kernel = quat_normalize_sse2;
+		quat_nlerp_kernel = quat_nlerp_sse2;
+		quat_slerp_kernel = quat_slerp_sse2;
+		mat4_from_quat_kernel = mat4_from_quat_sse2;
+		dquat_multiply_kernel = dquat_multiply_sse2;
+		dquat_nlerp_kernel = dquat_nlerp_sse2;
+		mat4_from_dquat_kernel = mat4_from_dquat_sse2;
+		norm16_kernel = norm16_sse2;
+		norm8_kernel = norm8_sse2;
+		pack_2_10_10_10_kernel = pack_2_10_10_10_sse2;
+		downsample_rgba_kernel = downsample_rgba_sse2;
+		transform_rgba_kernel = transform_rgba_sse2;
+	}
+	#endif
+
+	#if defined(__ARM_NEON)
+	if(features & DASH_CPU_NEON) {
+		mat4_multiply_kernel = mat4_multiply_neon;
+	}
+	#endif
+
+}
+
+static void mat4_multiply_select(mat4 a, mat4 b, mat4 m) {
+
+	simd_select();
+	mat4_multiply_kernel(a, b, m);
+
+}
+
+static void compose_block_select(float b[BATCH_ROWS][DASH_BATCH], mat4 *m, int n) {
+
+	simd_select();
+	compose_block_kernel(b, m, n);
+
+}
+
+static void sincos_poly_select(const float *x, float *s, float *c, int count) {
+
+	simd_select();
+	sincos_poly_kernel(x, s, c, count);
+
+}
+
+static int mat4_inverse_select(mat4 a, mat4 m) {
+
+	simd_select();
+	return mat4_inverse_kernel(a, m);
+
+}
+
+static int mat4_inverse_affine_select(mat4 a, mat4 m) {
+
+	simd_select();
+	return mat4_inverse_affine_kernel(a, m);
+
+}
+
+static void mat4_inverse_rigid_select(mat4 a, mat4 m) {
+
+	simd_select();
+	mat4_inverse_rigid_kernel(a, m);
+
+}
+
+static int mat3_normal_select(mat4 a, mat3 n) {
+
+	simd_select();
+	return mat3_normal_kernel(a, n);
+
+}
+
+static int cull_spheres_select(frustum f, vec3_soa c, float *r, int count, int *visible) {
+
+	simd_select();
+	return cull_spheres_kernel(f, c, r, count, visible);
+
+}
+
+static int cull_aabbs_select(frustum f, vec3_soa lo, vec3_soa hi, int count, int *visible) {
+
+	simd_select();
+	return cull_aabbs_kernel(f, lo, hi, count, visible);
+
+}
+
+static int quat_multiply_select(quat *a, quat *b, quat *q, int count) {
+
+	simd_select();
+	return quat_multiply_kernel(a, b, q, count);
+
+}
+
+static int quat_normalize_select(quat *a, quat *q, int count) {
+
+	simd_select();
+	return quat_normalize_kernel(a, q, count);
+
+}
+
+static int quat_nlerp_select(quat *a, quat *b, float *t, quat *q, int count) {
+
+	simd_select();
+	return quat_nlerp_kernel(a, b, t, q, count);
+
+}
+
+static int quat_slerp_select(quat *a, quat *b, float *t, quat *q, int count) {
+
+	simd_select();
+	return quat_slerp_kernel(a, b, t, q, count);
+
+}
+
+static int mat4_from_quat_select(quat *q, mat4 *m, int count) {
+
+	simd_select();
+	return mat4_from_quat_kernel(q, m, count);
+
+}
+
+static int dquat_multiply_select(dquat *a, dquat *b, dquat *d, int count) {
+
+	simd_select();
+	return dquat_multiply_kernel(a, b, d, count);
+
+}
+
+static int dquat_nlerp_select(dquat *a, dquat *b, float *t, dquat *d, int count) {
+
+	simd_select();
+	return dquat_nlerp_kernel(a, b, t, d, count);
+
+}
+
+static int mat4_from_dquat_select(dquat *d, mat4 *m, int count) {
+
+	simd_select();
+	return mat4_from_dquat_kernel(d, m, count);
+
+}
+
+static int half_encode_select(const float *src, unsigned short *dst, int count) {
+
+	simd_select();
+	return half_encode_kernel(src, dst, count);
+
+}
+
+static int half_decode_select(const unsigned short *src, float *dst, int count) {
+
+	simd_select();
+	return half_decode_kernel(src, dst, count);
+
+}
+
+static int norm16_select(const float *src, short *dst, int count, int is_signed) {
+
+	simd_select();
+	return norm16_kernel(src, dst, count, is_signed);
+
+}
+
+static int norm8_select(const float *src, signed char *dst, int count, int is_signed) {
+
+	simd_select();
+	return norm8_kernel(src, dst, count, is_signed);
+
+}
+
+static int pack_2_10_10_10_select(const float *src, unsigned int *dst, int count, int is_signed) {
+
+	simd_select();
+	return pack_2_10_10_10_kernel(src, dst, count, is_signed);
+
+}
+
+static int downsample_rgba_select(const unsigned char *r0, const unsigned char *r1, unsigned char *dst, int count) {
+
+	simd_select();
+	return downsample_rgba_kernel(r0, r1, dst, count);
+
+}
+
+static int transform_rgba_select(unsigned char *p, int count, int flags) {
+
+	simd_select();
+	return transform_rgba_kernel(p, count, flags);
+
+}
+
+/******************************************************************************/
+/** Trig Utils                                                               **/
+/******************************************************************************/
+
+static int trig_accuracy = DASH_TRIG_EXACT;
+
+void dash_trig_accuracy(int accuracy) {
+
+	trig_accuracy = accuracy;
+
+}
+
+void dash_sincosf(float x, float *s, float *c) {
+
+	if(trig_accuracy == DASH_TRIG_FAST) {
+		sincos_poly(x, s, c);
+		return;
+	}
+
+	*s = sinf(x);
+	*c = cosf(x);
+
+}
+
+void dash_sincosf_batch(const float *x, float *s, float *c, int count) {
+
+	int i;
+
+	if(trig_accuracy == DASH_TRIG_FAST) {
+		sincos_poly_kernel(x, s, c, count);
+		return;
+	}
+
+	for(i = 0; i < count; i++) {
+		s[i] = sinf(x[i]);
+		c[i] = cosf(x[i]);
+	}
+
+}
+
+/******************************************************************************/
+/** Matrix Utils                                                             **/
+/******************************************************************************/
+
+
+void mat4_identity(mat4 m) {
+	
+	m[M_00] = 1.0f;
+	m[M_01] = 0.0f;
+	m[M_02] = 0.0f;
+	m[M_03] = 0.0f;
+	m[M_10] = 0.0f;
+	m[M_11] = 1.0f;
+	m[M_12] = 0.0f;
+	m[M_13] = 0.0f;
+	m[M_20] = 0.0f;
+	m[M_21] = 0.0f;
+	m[M_22] = 1.0f;
+	m[M_23] = 0.0f;
+	m[M_30] = 0.0f;
+	m[M_31] = 0.0f;
+	m[M_32] = 0.0f;
+	m[M_33] = 1.0f;
+
+}
+
+void mat4_copy(mat4 a, mat4 m) {
+	
+	m[M_00] = a[M_00];
+	m[M_01] = a[M_01];
+	m[M_02] = a[M_02];
+	m[M_03] = a[M_03];
+	m[M_10] = a[M_10];
+	m[M_11] = a[M_11];
+	m[M_12] = a[M_12];
+	m[M_13] = a[M_13];
+	m[M_20] = a[M_20];
+	m[M_21] = a[M_21];
+	m[M_22] = a[M_22];
+	m[M_23] = a[M_23];
+	m[M_30] = a[M_30];
+	m[M_31] = a[M_31];
+	m[M_32] = a[M_32];
+	m[M_33] = a[M_33];
+
+}
+
+void mat4_translate(vec3 t, mat4 m) {
+
+	m[M_00] = 1.0f;
+	m[M_10] = 0.0f;
+	m[M_20] = 0.0f;
+	m[M_30] = 0.0f;
+	
+	m[M_01] = 0.0f;
+	m[M_11] = 1.0f;
+	m[M_21] = 0.0f;
+	m[M_31] = 0.0f;
+	
+	m[M_02] = 0.0f;
+	m[M_12] = 0.0f;
+	m[M_22] = 1.0f;
+	m[M_32] = 0.0f;
+	
+	m[M_03] = t[0];
+	m[M_13] = t[1];
+	m[M_23] = t[2];
+	m[M_33] = 1.0f;
+
+}
+
+void mat4_rotate_x(float x, mat4 m) {
+
+	float s, c;
+	dash_sincosf(x, &s, &c);
+
+	m[M_00] = 1.0f;
+	m[M_01] = 0.0f;
+	m[M_02] = 0.0f;
+	m[M_03] = 0.0f;
+	m[M_10] = 0.0f;
+	m[M_11] = c;
+	m[M_12] =-s;
+	m[M_13] = 0.0f;
+	m[M_20] = 0.0f;
+	m[M_21] = s;
+	m[M_22] = c;
+	m[M_23] = 0.0f;
+	m[M_30] = 0.0f;
+	m[M_31] = 0.0f;
+	m[M_32] = 0.0f;
+	m[M_33] = 1.0f;
+
+}
+
+void mat4_rotate_y(float y, mat4 m) {
+
+	float s, c;
+	dash_sincosf(y, &s, &c);
+
+	m[M_00] = c;
+	m[M_01] = 0.0f;
+	m[M_02] = s;
+	m[M_03] = 0.0f;
+	m[M_10] = 0.0f;
+	m[M_11] = 1.0f;
+	m[M_12] = 0.0f;
+	m[M_13] = 0.0f;
+	m[M_20] =-s;
+	m[M_21] = 0.0f;
+	m[M_22] = c;
+	m[M_23] = 0.0f;
+	m[M_30] = 0.0f;
+	m[M_31] = 0.0f;
+	m[M_32] = 0.0f;
+	m[M_33] = 1.0f;
+
+}
+
+void mat4_rotate_z(float z, mat4 m) {
+
+	float s, c;
+	dash_sincosf(z, &s, &c);
+
+	m[M_00] = c;
+	m[M_01] =-s;
+	m[M_02] = 0.0f;
+	m[M_03] = 0.0f;
+	m[M_10] = s;
+	m[M_11] = c;
+	m[M_12] = 0.0f;
+	m[M_13] = 0.0f;
+	m[M_20] = 0.0f;
+	m[M_21] = 0.0f;
+	m[M_22] = 1.0f;
+	m[M_23] = 0.0f;
+	m[M_30] = 0.0f;
+	m[M_31] = 0.0f;
+	m[M_32] = 0.0f;
+	m[M_33] = 1.0f;
+
+}
+
+
+void mat4_multiply(mat4 a, mat4 b, mat4 m) {
+
+	mat4_multiply_kernel(a, b, m);
+
+}
+
+void mat4_multiply_scalar(mat4 a, mat4 b, mat4 m) {
+
+	mat4 tmp;
+
+	tmp[M_00] = a[M_00]*b[M_00]+a[M_01]*b[M_10]+a[M_02]*b[M_20]+a[M_03]*b[M_30];
+	tmp[M_01] = a[M_00]*b[M_01]+a[M_01]*b[M_11]+a[M_02]*b[M_21]+a[M_03]*b[M_31];
+	tmp[M_02] = a[M_00]*b[M_02]+a[M_01]*b[M_12]+a[M_02]*b[M_22]+a[M_03]*b[M_32];
+	tmp[M_03] = a[M_00]*b[M_03]+a[M_01]*b[M_13]+a[M_02]*b[M_23]+a[M_03]*b[M_33];
+   
+	tmp[M_10] = a[M_10]*b[M_00]+a[M_11]*b[M_10]+a[M_12]*b[M_20]+a[M_13]*b[M_30];
+	tmp[M_11] = a[M_10]*b[M_01]+a[M_11]*b[M_11]+a[M_12]*b[M_21]+a[M_13]*b[M_31];
+	tmp[M_12] = a[M_10]*b[M_02]+a[M_11]*b[M_12]+a[M_12]*b[M_22]+a[M_13]*b[M_32];
+	tmp[M_13] = a[M_10]*b[M_03]+a[M_11]*b[M_13]+a[M_12]*b[M_23]+a[M_13]*b[M_33];
+ 
+	tmp[M_20] = a[M_20]*b[M_00]+a[M_21]*b[M_10]+a[M_22]*b[M_20]+a[M_23]*b[M_30];
+	tmp[M_21] = a[M_20]*b[M_01]+a[M_21]*b[M_11]+a[M_22]*b[M_21]+a[M_23]*b[M_31];
+	tmp[M_22] = a[M_20]*b[M_02]+a[M_21]*b[M_12]+a[M_22]*b[M_22]+a[M_23]*b[M_32];
+	tmp[M_23] = a[M_20]*b[M_03]+a[M_21]*b[M_13]+a[M_22]*b[M_23]+a[M_23]*b[M_33];
+ 
+	tmp[M_30] = a[M_30]*b[M_00]+a[M_31]*b[M_10]+a[M_32]*b[M_20]+a[M_33]*b[M_30];
+	tmp[M_31] = a[M_30]*b[M_01]+a[M_31]*b[M_11]+a[M_32]*b[M_21]+a[M_33]*b[M_31];
+	tmp[M_32] = a[M_30]*b[M_02]+a[M_31]*b[M_12]+a[M_32]*b[M_22]+a[M_33]*b[M_32];
+	tmp[M_33] = a[M_30]*b[M_03]+a[M_31]*b[M_13]+a[M_32]*b[M_23]+a[M_33]*b[M_33];
+
+	mat4_copy(tmp, m);
+
+}
+
+void mat4_rotate(vec3 r, mat4 m) {
+
+	vec3 t = { 0.0f, 0.0f, 0.0f };
+	mat4_compose(t, r, NULL, m);
+
+}
+
+/*
+ * Writes translate(t) * rotate(r) * scale(s) directly, with the product of
+ * the three euler rotations expanded in closed form. s may be NULL for a
+ * unit scale.
+ */
+
+void mat4_compose(vec3 t, vec3 r, vec3 s, mat4 m) {
+
+	float cx, sx, cy, sy, cz, sz, kx, ky, kz;
+
+	dash_sincosf(r[0], &sx, &cx);
+	dash_sincosf(r[1], &sy, &cy);
+	dash_sincosf(r[2], &sz, &cz);
+
+	kx = s ? s[0] : 1.0f;
+	ky = s ? s[1] : 1.0f;
+	kz = s ? s[2] : 1.0f;
+
+	m[M_00] = cy*cz * kx;
+	m[M_10] = (sx*sy*cz + cx*sz) * kx;
+	m[M_20] = (sx*sz - cx*sy*cz) * kx;
+	m[M_30] = 0.0f;
+
+	m[M_01] = -cy*sz * ky;
+	m[M_11] = (cx*cz - sx*sy*sz) * ky;
+	m[M_21] = (cx*sy*sz + sx*cz) * ky;
+	m[M_31] = 0.0f;
+
+	m[M_02] = sy * kz;
+	m[M_12] = -sx*cy * kz;
+	m[M_22] = cx*cy * kz;
+	m[M_32] = 0.0f;
+
+	m[M_03] = t[0];
+	m[M_13] = t[1];
+	m[M_23] = t[2];
+	m[M_33] = 1.0f;
+
+}
+
+
+void mat4_look_at(vec3 eye, vec3 center, vec3 up, mat4 m) {
+	
+	mat4 a;
+	vec3 f, s, t;
+	
+	vec3_subtract(center, eye, f);
+	vec3_normalize(f, f);
+
+	vec3_cross_multiply(f, up, s);
+	vec3_normalize(s, s);
+
+	vec3_cross_multiply(s, f, t);
+
+	m[0] = s[0];
+	m[1] = t[0];
+	m[2] =-f[0];
+	m[3] = 0.0f;
+
+	m[4] = s[1];
+	m[5] = t[1];
+	m[6] =-f[1];
+	m[7] = 0.0f;
+
+	m[8] = s[2];
+	m[9] = t[2];
+	m[10] = -f[2];
+	m[11] = 0.0f;
+
+	m[12] = 0.0f;
+	m[13] = 0.0f;
+	m[14] = 0.0f;
+	m[15] = 1.0f;
+
+	eye[0] = -eye[0];
+	eye[1] = -eye[1];
+	eye[2] = -eye[2];
+
+	mat4_translate(eye, a);
+	mat4_multiply(m, a, m);
+
+}
+
+void mat4_perspective(float y_fov, float aspect, float n, float f, mat4 m) {
+
+	float const a = 1.f / (float) tan(y_fov / 2.f);
+
+	m[0] = a / aspect;
+	m[1] = 0.0f;
+	m[2] = 0.0f;
+	m[3] = 0.0f;
+
+	m[4] = 0.0f;
+	m[5] = a;
+	m[6] = 0.0f;
+	m[7] = 0.0f;
+
+	m[8] = 0.0f;
+	m[9] = 0.0f;
+	m[10] = -((f + n) / (f - n));
+	m[11] = -1.0f;
+
+	m[12] = 0.0f;
+	m[13] = 0.0f;
+	m[14] = -((2.0f * f * n) / (f - n));
+	m[15] = 0.0f;
+
+}
+
+void mat4_orthographic(int left, int right, int top, int bottom, mat4 m) {
+	
+	if(left == right) {
+		fprintf(stderr, "mat4_orthographic left cannot equal right\n");
+		exit(1);
+	}
+
+	if(top == bottom) {
+		fprintf(stderr, "mat4_orthographic top cannot equal bottom\n");
+		exit(1);
+	}
+
+	float zNear = -0.1f;
+	float zFar = 1.0f;
+	float inv_z = 1.0f / (zFar - zNear);
+	float inv_y = 1.0f / (top - bottom);
+	float inv_x = 1.0f / (right - left);
+
+    m[M_00] = 2.0f * inv_x;
+    m[M_10] = 0.0f;
+    m[M_20] = 0.0f;
+    m[M_30] = 0.0f;
+
+    m[M_01] = 0.0f;
+    m[M_11] = 2.0f * inv_y;
+    m[M_21] = 0.0f;
+    m[M_31] = 0.0f;
+
+    m[M_02] = 0.0f;
+    m[M_12] = 0.0f;
+    m[M_22] = -2.0f * inv_z;
+    m[M_32] = 0.0f;
+
+    m[M_03] = -(right + left)*inv_x;
+    m[M_13] = -(top + bottom)*inv_y;
+    m[M_23] = -(zFar + zNear)*inv_z;
+    m[M_33] = 1.0f;
+
+}
+
+/******************************************************************************/
+/** Inverse Utils                                                            **/
+/******************************************************************************/
+
+/*
+ * mat4_inverse and mat4_inverse_affine return 0 and leave m untouched when
+ * the matrix is singular. mat4_inverse_affine expects a bottom row of
+ * (0, 0, 0, 1). mat4_inverse_rigid further assumes the upper 3x3 is a pure
+ * rotation, such as the output of mat4_translate, mat4_rotate and
+ * mat4_look_at, and simply transposes it.
+ */
+
+int mat4_inverse(mat4 a, mat4 m) {
+
+	return mat4_inverse_kernel(a, m);
+
+}
+
+int mat4_inverse_affine(mat4 a, mat4 m) {
+
+	return mat4_inverse_affine_kernel(a, m);
+
+}
+
+void mat4_inverse_rigid(mat4 a, mat4 m) {
+
+	mat4_inverse_rigid_kernel(a, m);
+
+}
+
+/*
+ * Inverse transpose of the upper 3x3, ready for glUniformMatrix3fv. Returns
+ * 0 when the matrix is singular.
+ */
+
+int mat3_normal(mat4 a, mat3 n) {
+
+	return mat3_normal_kernel(a, n);
+
+}
+
+/******************************************************************************/
+/** Frustum Utils                                                            **/
+/******************************************************************************/
+
+/*
+ * Extracts the left, right, bottom, top, near and far planes from a
+ * view-projection matrix (Gribb and Hartmann). Planes are normalized and
+ * face inward, so a point p is inside when dot(plane.xyz, p) + plane.w >= 0.
+ */
+
+void frustum_from_mat4(mat4 vp, frustum f) {
+
+	int p, i;
+	float len, sign;
+
+	for(p = 0; p < 6; p++) {
+
+		i = p / 2;
+		sign = (p % 2 == 0) ? 1.0f : -1.0f;
+
+		f[p][0] = vp[M_30] + sign * vp[i];
+		f[p][1] = vp[M_31] + sign * vp[4 + i];
+		f[p][2] = vp[M_32] + sign * vp[8 + i];
+		f[p][3] = vp[M_33] + sign * vp[12 + i];
+
+		len = sqrtf(f[p][0]*f[p][0] + f[p][1]*f[p][1] + f[p][2]*f[p][2]);
+		f[p][0] /= len;
+		f[p][1] /= len;
+		f[p][2] /= len;
+		f[p][3] /= len;
+
+	}
+
+}
+
+/*
+ * Both functions write the indices of the volumes that intersect the
+ * frustum to visible, in increasing order, and return how many there are.
+ * visible must have room for count indices.
+ */
+
+int frustum_cull_spheres(frustum f, vec3_soa center, float *radius, int count, int *visible) {
+
+	return cull_spheres_kernel(f, center, radius, count, visible);
+
+}
+
+int frustum_cull_aabbs(frustum f, vec3_soa min, vec3_soa max, int count, int *visible) {
+
+	return cull_aabbs_kernel(f, min, max, count, visible);
+
+}
+
+/******************************************************************************/
+/** Camera Utils                                                             **/
+/******************************************************************************/
+
+/*
+ * Call once per frame after changing projection or view. Combines them into
+ * view_projection and refreshes the culling planes, so each object only
+ * needs one more product to get the matrix its vertex shader consumes.
+ */
+
+void camera_update(camera *c) {
+
+	mat4_multiply(c->projection, c->view, c->view_projection);
+	frustum_from_mat4(c->view_projection, c->planes);
+
+}
+
+void camera_mvp(camera *c, mat4 model, mat4 m) {
+
+	mat4_multiply(c->view_projection, model, m);
+
+}
+
+void camera_mvp_batch(camera *c, mat4 *model, mat4 *m, int count) {
+
+	int i;
+
+	if(mat4_multiply_kernel == mat4_multiply_select) {
+		simd_select();
+	}
+
+	for(i = 0; i < count; i++) {
+		mat4_multiply_kernel(c->view_projection, model[i], m[i]);
+	}
+
+}
+
+/******************************************************************************/
+/** Transform Utils                                                          **/
+/******************************************************************************/
+
+/*
+ * Nodes live in flat arrays ordered so that every parent comes before its
+ * children, which lets transform_update walk the hierarchy in one linear
+ * pass. Each node keeps its local translation, rotation and scale and a
+ * cached world matrix that is only rebuilt when the node or one of its
+ * ancestors changed since the last update.
+ */
+
+#define TRANSFORM_DIRTY 1
+
+static int transform_grow(transform_tree *t, int capacity) {
+
+	void *p;
+
+	#define TRANSFORM_REALLOC(field) \
+		p = realloc(t->field, sizeof(*t->field) * capacity); \
+		if(p == NULL) { \
+			return 0; \
+		} \
+		t->field = p;
+
+	TRANSFORM_REALLOC(parent);
+	TRANSFORM_REALLOC(translation);
+	TRANSFORM_REALLOC(rotation);
+	TRANSFORM_REALLOC(scale);
+	TRANSFORM_REALLOC(world);
+	TRANSFORM_REALLOC(updated);
+	TRANSFORM_REALLOC(dirty);
+
+	#undef TRANSFORM_REALLOC
+
+	t->capacity = capacity;
+	return 1;
+
+}
+
+int transform_tree_init(transform_tree *t, int capacity) {
+
+	memset(t, 0, sizeof(transform_tree));
+	return transform_grow(t, capacity > 0 ? capacity : 16);
+
+}
+
+void transform_tree_free(transform_tree *t) {
+
+	free(t->parent);
+	free(t->translation);
+	free(t->rotation);
+	free(t->scale);
+	free(t->world);
+	free(t->updated);
+	free(t->dirty);
+	memset(t, 0, sizeof(transform_tree));
+
+}
+
+/*
+ * Appends an identity node under parent (-1 for a root) and returns its
+ * index, or -1 if parent is not an existing node or memory runs out.
+ * Because the parent already exists, appending keeps parents first.
+ */
+
+int transform_add(transform_tree *t, int parent) {
+
+	int i;
+
+	if(parent < -1 || parent >= t->count) {
+		fprintf(stderr, "transform_add invalid parent %d\n", parent);
+		return -1;
+	}
+
+	if(t->count == t->capacity && !transform_grow(t, t->capacity * 2)) {
+		return -1;
+	}
+
+	i = t->count++;
+	t->parent[i] = parent;
+	t->translation[i][0] = t->translation[i][1] = t->translation[i][2] = 0.0f;
+	t->scale[i][0] = t->scale[i][1] = t->scale[i][2] = 1.0f;
+	quat_identity(t->rotation[i]);
+	mat4_identity(t->world[i]);
+	t->updated[i] = t->frame;
+	t->dirty[i] = TRANSFORM_DIRTY;
+
+	return i;
+
+}
+
+void transform_set_translation(transform_tree *t, int node, vec3 v) {
+
+	t->translation[node][0] = v[0];
+	t->translation[node][1] = v[1];
+	t->translation[node][2] = v[2];
+	t->dirty[node] = TRANSFORM_DIRTY;
+
+}
+
+void transform_set_rotation(transform_tree *t, int node, quat q) {
+
+	quat_copy(q, t->rotation[node]);
+	t->dirty[node] = TRANSFORM_DIRTY;
+
+}
+
+void transform_set_scale(transform_tree *t, int node, vec3 s) {
+
+	t->scale[node][0] = s[0];
+	t->scale[node][1] = s[1];
+	t->scale[node][2] = s[2];
+	t->dirty[node] = TRANSFORM_DIRTY;
+
+}
+
+/*
+ * Rebuilds the world matrix of every dirty node and of every node whose
+ * parent was rebuilt in this same pass, then clears the dirty flags.
+ * Returns the number of world matrices recomputed.
+ */
+
+int transform_update(transform_tree *t) {
+
+	int i, p, n;
+	mat4 local;
+
+	t->frame++;
+	n = 0;
+
+	for(i = 0; i < t->count; i++) {
+
+		p = t->parent[i];
+		if(!t->dirty[i] && (p < 0 || t->updated[p] != t->frame)) {
+			continue;
+		}
+
+		if(p < 0) {
+			mat4_compose_quat(t->translation[i], t->rotation[i], t->scale[i], t->world[i]);
+		} else {
+			mat4_compose_quat(t->translation[i], t->rotation[i], t->scale[i], local);
+			mat4_multiply(t->world[p], local, t->world[i]);
+		}
+
+		t->updated[i] = t->frame;
+		t->dirty[i] = 0;
+		n++;
+
+	}
+
+	return n;
+
+}
+
+/******************************************************************************/
+/** Vertex Format Utils                                                      **/
+/******************************************************************************/
+
+/*
+ * Compact attribute encodings. Normalized formats follow the GL rules:
+ * values are clamped to [-1, 1] or [0, 1], NaN becomes the lower bound, and
+ * SNORM maps -1 to -MAX so zero is exact. Rounding is to nearest even.
+ */
+
+static int norm_round(float f, float lo, float scale) {
+
+	f = f > lo ? f : lo;
+	f = f < 1.0f ? f : 1.0f;
+	f *= scale;
+
+	// Adding 1.5 * 2^23 pushes the fraction out in the current rounding mode
+	return (int)((f + 12582912.0f) - 12582912.0f);
+
+}
+
+unsigned short dash_float_to_half(float f) {
+
+	unsigned int u, sign;
+	union { float f; unsigned int u; } v, magic;
+
+	v.f = f;
+	sign = v.u & 0x80000000u;
+	u = v.u ^ sign;
+
+	if(u >= (127 + 16) << 23) {
+		// Overflow to infinity, keep NaN quiet
+		u = u > 255u << 23 ? 0x7e00 : 0x7c00;
+	} else if(u < (127 - 14) << 23) {
+		v.u = u;
+		magic.u = 126 << 23;
+		v.f += magic.f;
+		u = v.u - magic.u;
+	} else {
+		u += 0xfff - ((127 - 15) << 23) + ((u >> 13) & 1);
+		u >>= 13;
+	}
+
+	return (unsigned short)(u | (sign >> 16));
+
+}
+
+float dash_half_to_float(unsigned short h) {
+
+	union { float f; unsigned int u; } v, magic;
+	unsigned int exp_mant = h & 0x7fff;
+
+	magic.u = (254 - 15) << 23;
+	v.u = exp_mant << 13;
+	v.f *= magic.f;
+
+	if(exp_mant > 0x7bff) {
+		v.u |= 255 << 23;
+	}
+
+	v.u |= (unsigned int)(h & 0x8000) << 16;
+	return v.f;
+
+}
+
+short dash_float_to_snorm16(float f) {
+
+	return (short)norm_round(f, -1.0f, 32767.0f);
+
+}
+
+unsigned short dash_float_to_unorm16(float f) {
+
+	return (unsigned short)norm_round(f, 0.0f, 65535.0f);
+
+}
+
+signed char dash_float_to_snorm8(float f) {
+
+	return (signed char)norm_round(f, -1.0f, 127.0f);
+
+}
+
+unsigned char dash_float_to_unorm8(float f) {
+
+	return (unsigned char)norm_round(f, 0.0f, 255.0f);
+
+}
+
+/*
+ * Packs x, y and z into 10 bits each and w into the top 2 bits, in the
+ * GL_INT_2_10_10_10_REV and GL_UNSIGNED_INT_2_10_10_10_REV layouts.
+ */
+
+unsigned int dash_pack_snorm_2_10_10_10(float x, float y, float z, float w) {
+
+	unsigned int p;
+
+	p = (unsigned int)norm_round(x, -1.0f, 511.0f) & 0x3ff;
+	p |= ((unsigned int)norm_round(y, -1.0f, 511.0f) & 0x3ff) << 10;
+	p |= ((unsigned int)norm_round(z, -1.0f, 511.0f) & 0x3ff) << 20;
+	p |= (unsigned int)norm_round(w, -1.0f, 1.0f) << 30;
+
+	return p;
+
+}
+
+unsigned int dash_pack_unorm_2_10_10_10(float x, float y, float z, float w) {
+
+	unsigned int p;
+
+	p = (unsigned int)norm_round(x, 0.0f, 1023.0f);
+	p |= (unsigned int)norm_round(y, 0.0f, 1023.0f) << 10;
+	p |= (unsigned int)norm_round(z, 0.0f, 1023.0f) << 20;
+	p |= (unsigned int)norm_round(w, 0.0f, 3.0f) << 30;
+
+	return p;
+
+}
+
+void dash_float_to_half_batch(const float *src, unsigned short *dst, int count) {
+
+	int i;
+
+	i = half_encode_kernel(src, dst, count);
+
+	for(; i < count; i++) {
+		dst[i] = dash_float_to_half(src[i]);
+	}
+
+}
+
+void dash_half_to_float_batch(const unsigned short *src, float *dst, int count) {
+
+	int i;
+
+	i = half_decode_kernel(src, dst, count);
+
+	for(; i < count; i++) {
+		dst[i] = dash_half_to_float(src[i]);
+	}
+
+}
+
+void dash_float_to_snorm16_batch(const float *src, short *dst, int count) {
+
+	int i;
+
+	i = norm16_kernel(src, dst, count, 1);
+
+	for(; i < count; i++) {
+		dst[i] = dash_float_to_snorm16(src[i]);
+	}
+
+}
+
+void dash_float_to_unorm16_batch(const float *src, unsigned short *dst, int count) {
+
+	int i;
+
+	i = norm16_kernel(src, (short*)dst, count, 0);
+
+	for(; i < count; i++) {
+		dst[i] = dash_float_to_unorm16(src[i]);
+	}
+
+}
+
+void dash_float_to_snorm8_batch(const float *src, signed char *dst, int count) {
+
+	int i;
+
+	i = norm8_kernel(src, dst, count, 1);
+
+	for(; i < count; i++) {
+		dst[i] = dash_float_to_snorm8(src[i]);
+	}
+
+}
+
+void dash_float_to_unorm8_batch(const float *src, unsigned char *dst, int count) {
+
+	int i;
+
+	i = norm8_kernel(src, (signed char*)dst, count, 0);
+
+	for(; i < count; i++) {
+		dst[i] = dash_float_to_unorm8(src[i]);
+	}
+
+}
+
+// src holds count xyzw groups
+void dash_pack_snorm_2_10_10_10_batch(const float *src, unsigned int *dst, int count) {
+
+	int i;
+
+	i = pack_2_10_10_10_kernel(src, dst, count, 1);
+
+	for(; i < count; i++) {
+		dst[i] = dash_pack_snorm_2_10_10_10(src[i*4], src[i*4 + 1], src[i*4 + 2], src[i*4 + 3]);
+	}
+
+}
+
+void dash_pack_unorm_2_10_10_10_batch(const float *src, unsigned int *dst, int count) {
+
+	int i;
+
+	i = pack_2_10_10_10_kernel(src, dst, count, 0);
+
+	for(; i < count; i++) {
+		dst[i] = dash_pack_unorm_2_10_10_10(src[i*4], src[i*4 + 1], src[i*4 + 2], src[i*4 + 3]);
+	}
+
+}
+
+/*
+ * glVertexAttribPointer for one of the DASH_ATTRIB_* formats. Half floats
+ * need GL 3.0 or ARB_half_float_vertex and the packed formats need GL 3.3
+ * or ARB_vertex_type_2_10_10_10_rev (with size 4); returns 0 without
+ * touching the attribute when the context lacks them.
+ */
+
+int dash_vertex_attrib(GLint location, GLint size, int format, GLsizei stride, size_t offset) {
+
+	GLenum type;
+	GLboolean normalized = GL_TRUE;
+
+	switch(format) {
+		case DASH_ATTRIB_FLOAT:
+			type = GL_FLOAT;
+			normalized = GL_FALSE;
+			break;
+		case DASH_ATTRIB_HALF:
+			if(!GLEW_VERSION_3_0 && !GLEW_ARB_half_float_vertex) {
+				fprintf(stderr, "dash_vertex_attrib half float vertices not supported\n");
+				return 0;
+			}
+			type = GL_HALF_FLOAT;
+			normalized = GL_FALSE;
+			break;
+		case DASH_ATTRIB_SNORM8:
+			type = GL_BYTE;
+			break;
+		case DASH_ATTRIB_UNORM8:
+			type = GL_UNSIGNED_BYTE;
+			break;
+		case DASH_ATTRIB_SNORM16:
+			type = GL_SHORT;
+			break;
+		case DASH_ATTRIB_UNORM16:
+			type = GL_UNSIGNED_SHORT;
+			break;
+		case DASH_ATTRIB_SNORM_2_10_10_10:
+		case DASH_ATTRIB_UNORM_2_10_10_10:
+			if(!GLEW_VERSION_3_3 && !GLEW_ARB_vertex_type_2_10_10_10_rev) {
+				fprintf(stderr, "dash_vertex_attrib 2_10_10_10 vertices not supported\n");
+				return 0;
+			}
+			type = format == DASH_ATTRIB_SNORM_2_10_10_10 ?
+				GL_INT_2_10_10_10_REV : GL_UNSIGNED_INT_2_10_10_10_REV;
+			size = 4;
+			break;
+		default:
+			fprintf(stderr, "dash_vertex_attrib unknown format %d\n", format);
+			return 0;
+	}
+
+	glVertexAttribPointer(location, size, type, normalized, stride, (void*)offset);
+	return 1;
+
+}
+
+/******************************************************************************/
+/** Image Utils                                                              **/
+/******************************************************************************/
+
+/*
+ * Halves an 8-bit image to max(1, width/2) by max(1, height/2) by averaging
+ * 2x2 blocks with rounding. An odd last row or column is dropped, and a
+ * dimension of 1 reuses its only row or column.
+ */
+
+void dash_image_downsample(const unsigned char *src, int width, int height, int channels, unsigned char *dst) {
+
+	int x, y, c, i, dw, dh, x1, stride;
+	const unsigned char *r0, *r1;
+	unsigned char *out;
+
+	dw = width > 1 ? width / 2 : 1;
+	dh = height > 1 ? height / 2 : 1;
+	stride = width * channels;
+
+	for(y = 0; y < dh; y++) {
+		r0 = src + (2 * y) * stride;
+		r1 = height > 1 ? r0 + stride : r0;
+		out = dst + y * dw * channels;
+		x = 0;
+
+		if(channels == 4 && width > 1) {
+			x = downsample_rgba_kernel(r0, r1, out, dw);
+		}
+
+		for(; x < dw; x++) {
+			x1 = width > 1 ? 2 * x + 1 : 0;
+			for(c = 0; c < channels; c++) {
+				i = r0[2*x*channels + c] + r0[x1*channels + c];
+				i += r1[2*x*channels + c] + r1[x1*channels + c];
+				out[x*channels + c] = (unsigned char)((i + 2) >> 2);
+			}
+		}
+	}
+
+}
+
+/*
+ * Applies DASH_IMAGE_* flags to an 8-bit image in place. PREMULTIPLY scales
+ * the color of two and four channel images by their last channel, SWAP_RB
+ * exchanges the first and third channels of three and four channel images,
+ * and FLIP_Y reverses the rows. Texture loading flips while decoding, so only
+ * the per-pixel part runs there.
+ */
+
+void dash_image_transform(unsigned char *data, int width, int height, int channels, int flags) {
+
+	int x, y, c, t, alpha, stride;
+	unsigned char *top, *bottom, *p, swap;
+
+	stride = width * channels;
+
+	if(flags & DASH_IMAGE_FLIP_Y) {
+		for(y = 0; y < height / 2; y++) {
+			top = data + y * stride;
+			bottom = data + (height - 1 - y) * stride;
+			for(x = 0; x < stride; x++) {
+				swap = top[x];
+				top[x] = bottom[x];
+				bottom[x] = swap;
+			}
+		}
+	}
+
+	if(channels < 3) {
+		flags &= ~DASH_IMAGE_SWAP_RB;
+	}
+	if(channels != 2 && channels != 4) {
+		flags &= ~DASH_IMAGE_PREMULTIPLY;
+	}
+	if(!(flags & (DASH_IMAGE_PREMULTIPLY | DASH_IMAGE_SWAP_RB))) {
+		return;
+	}
+
+	for(y = 0; y < height; y++) {
+		p = data + y * stride;
+		x = 0;
 
-	m[0] = s[0];
-	m[1] = t[0];
-	m[2] =-f[0];
-	m[3] = 0.0f;
+		if(channels == 4) {
+			x = transform_rgba_kernel(p, width, flags);
+		}
 
-	m[4] = s[1];
-	m[5] = t[1];
-	m[6] =-f[1];
-	m[7] = 0.0f;
+		for(; x < width; x++) {
+			if(flags & DASH_IMAGE_PREMULTIPLY) {
+				alpha = p[x*channels + channels - 1];
+				for(c = 0; c < channels - 1; c++) {
+					t = p[x*channels + c] * alpha + 128;
+					p[x*channels + c] = (unsigned char)((t + (t >> 8)) >> 8);
+				}
+			}
+			if(flags & DASH_IMAGE_SWAP_RB) {
+				swap = p[x*channels];
+				p[x*channels] = p[x*channels + 2];
+				p[x*channels + 2] = swap;
+			}
+		}
+	}
 
-	m[8] = s[2];
-	m[9] = t[2];
-	m[10] = -f[2];
-	m[11] = 0.0f;
+}
 
-	m[12] = 0.0f;
-	m[13] = 0.0f;
-	m[14] = 0.0f;
-	m[15] = 1.0f;
+/******************************************************************************/
+/** Quaternion Utils                                                         **/
+/******************************************************************************/
 
-	eye[0] = -eye[0];
-	eye[1] = -eye[1];
-	eye[2] = -eye[2];
+void quat_identity(quat q) {
 
-	mat4_translate(eye, a);
-	mat4_multiply(m, a, m);
+	q[0] = 0.0f;
+	q[1] = 0.0f;
+	q[2] = 0.0f;
+	q[3] = 1.0f;
 
 }
 
-void mat4_perspective(float y_fov, float aspect, float n, float f, mat4 m) {
+void quat_copy(quat a, quat q) {
 
-	float const a = 1.f / (float) tan(y_fov / 2.f);
+	q[0] = a[0];
+	q[1] = a[1];
+	q[2] = a[2];
+	q[3] = a[3];
 
-	m[0] = a / aspect;
-	m[1] = 0.0f;
-	m[2] = 0.0f;
-	m[3] = 0.0f;
+}
 
-	m[4] = 0.0f;
-	m[5] = a;
-	m[6] = 0.0f;
-	m[7] = 0.0f;
+void quat_from_axis_angle(vec3 axis, float angle, quat q) {
 
-	m[8] = 0.0f;
-	m[9] = 0.0f;
-	m[10] = -((f + n) / (f - n));
-	m[11] = -1.0f;
+	float s, c;
+	vec3 n;
 
-	m[12] = 0.0f;
-	m[13] = 0.0f;
-	m[14] = -((2.0f * f * n) / (f - n));
-	m[15] = 0.0f;
+	vec3_normalize(axis, n);
+	dash_sincosf(angle * 0.5f, &s, &c);
+
+	q[0] = n[0] * s;
+	q[1] = n[1] * s;
+	q[2] = n[2] * s;
+	q[3] = c;
 
 }
 
-void mat4_orthographic(int left, int right, int top, int bottom, mat4 m) {
-	
-	if(left == right) {
-		fprintf(stderr, "mat4_orthographic left cannot equal right\n");
-		exit(1);
+/*
+ * Same convention as mat4_rotate: the result rotates about z, then y,
+ * then x, so mat4_from_quat gives the same matrix.
+ */
+
+void quat_from_euler(vec3 r, quat q) {
+
+	float sx, cx, sy, cy, sz, cz;
+
+	dash_sincosf(r[0] * 0.5f, &sx, &cx);
+	dash_sincosf(r[1] * 0.5f, &sy, &cy);
+	dash_sincosf(r[2] * 0.5f, &sz, &cz);
+
+	q[0] = sx*cy*cz + cx*sy*sz;
+	q[1] = cx*sy*cz - sx*cy*sz;
+	q[2] = cx*cy*sz + sx*sy*cz;
+	q[3] = cx*cy*cz - sx*sy*sz;
+
+}
+
+void quat_multiply(quat a, quat b, quat q) {
+
+	quat tmp;
+
+	tmp[0] = a[3]*b[0] + a[0]*b[3] + a[1]*b[2] - a[2]*b[1];
+	tmp[1] = a[3]*b[1] + a[1]*b[3] + a[2]*b[0] - a[0]*b[2];
+	tmp[2] = a[3]*b[2] + a[2]*b[3] + a[0]*b[1] - a[1]*b[0];
+	tmp[3] = a[3]*b[3] - a[0]*b[0] - a[1]*b[1] - a[2]*b[2];
+
+	quat_copy(tmp, q);
+
+}
+
+void quat_conjugate(quat a, quat q) {
+
+	q[0] = -a[0];
+	q[1] = -a[1];
+	q[2] = -a[2];
+	q[3] = a[3];
+
+}
+
+float quat_dot(quat a, quat b) {
+
+	return a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+
+}
+
+void quat_normalize(quat a, quat q) {
+
+	float p = 1.0f / sqrtf(quat_dot(a, a));
+
+	q[0] = a[0] * p;
+	q[1] = a[1] * p;
+	q[2] = a[2] * p;
+	q[3] = a[3] * p;
+
+}
+
+void quat_nlerp(quat a, quat b, float t, quat q) {
+
+	float wb = quat_dot(a, b) < 0.0f ? -t : t;
+	float wa = 1.0f - t;
+
+	q[0] = a[0]*wa + b[0]*wb;
+	q[1] = a[1]*wa + b[1]*wb;
+	q[2] = a[2]*wa + b[2]*wb;
+	q[3] = a[3]*wa + b[3]*wb;
+
+	quat_normalize(q, q);
+
+}
+
+void quat_slerp(quat a, quat b, float t, quat q) {
+
+	float d, theta, st, wa, wb, sign;
+
+	d = quat_dot(a, b);
+	sign = 1.0f;
+	if(d < 0.0f) {
+		d = -d;
+		sign = -1.0f;
 	}
 
-	if(top == bottom) {
-		fprintf(stderr, "mat4_orthographic top cannot equal bottom\n");
-		exit(1);
+	// Nearly parallel, sin(theta) is too small to divide by
+	if(d > 0.9995f) {
+		quat_nlerp(a, b, t, q);
+		return;
 	}
 
-	float zNear = -0.1f;
-	float zFar = 1.0f;
-	float inv_z = 1.0f / (zFar - zNear);
-	float inv_y = 1.0f / (top - bottom);
-	float inv_x = 1.0f / (right - left);
+	theta = acosf(d);
+	st = sinf(theta);
+	wa = sinf((1.0f - t) * theta) / st;
+	wb = sign * sinf(t * theta) / st;
 
-    m[M_00] = 2.0f * inv_x;
-    m[M_10] = 0.0f;
-    m[M_20] = 0.0f;
-    m[M_30] = 0.0f;
+	q[0] = a[0]*wa + b[0]*wb;
+	q[1] = a[1]*wa + b[1]*wb;
+	q[2] = a[2]*wa + b[2]*wb;
+	q[3] = a[3]*wa + b[3]*wb;
 
-    m[M_01] = 0.0f;
-    m[M_11] = 2.0f * inv_y;
-    m[M_21] = 0.0f;
-    m[M_31] = 0.0f;
+}
 
-    m[M_02] = 0.0f;
-    m[M_12] = 0.0f;
-    m[M_22] = -2.0f * inv_z;
-    m[M_32] = 0.0f;
+void mat4_from_quat(quat q, mat4 m) {
 
-    m[M_03] = -(right + left)*inv_x;
-    m[M_13] = -(top + bottom)*inv_y;
-    m[M_23] = -(zFar + zNear)*inv_z;
-    m[M_33] = 1.0f;
+	vec3 t = { 0.0f, 0.0f, 0.0f };
+	mat4_compose_quat(t, q, NULL, m);
+
+}
+
+void mat4_compose_quat(vec3 t, quat q, vec3 s, mat4 m) {
+
+	float xx, yy, zz, xy, xz, yz, wx, wy, wz, kx, ky, kz;
+
+	xx = q[0]*q[0];
+	yy = q[1]*q[1];
+	zz = q[2]*q[2];
+	xy = q[0]*q[1];
+	xz = q[0]*q[2];
+	yz = q[1]*q[2];
+	wx = q[3]*q[0];
+	wy = q[3]*q[1];
+	wz = q[3]*q[2];
+
+	kx = s ? s[0] : 1.0f;
+	ky = s ? s[1] : 1.0f;
+	kz = s ? s[2] : 1.0f;
+
+	m[M_00] = (1.0f - 2.0f*(yy + zz)) * kx;
+	m[M_10] = 2.0f*(xy + wz) * kx;
+	m[M_20] = 2.0f*(xz - wy) * kx;
+	m[M_30] = 0.0f;
+
+	m[M_01] = 2.0f*(xy - wz) * ky;
+	m[M_11] = (1.0f - 2.0f*(xx + zz)) * ky;
+	m[M_21] = 2.0f*(yz + wx) * ky;
+	m[M_31] = 0.0f;
+
+	m[M_02] = 2.0f*(xz + wy) * kz;
+	m[M_12] = 2.0f*(yz - wx) * kz;
+	m[M_22] = (1.0f - 2.0f*(xx + yy)) * kz;
+	m[M_32] = 0.0f;
+
+	m[M_03] = t[0];
+	m[M_13] = t[1];
+	m[M_23] = t[2];
+	m[M_33] = 1.0f;
+
+}
+
+/******************************************************************************/
+/** Dual Quaternion Utils                                                    **/
+/******************************************************************************/
+
+/*
+ * A dual quaternion stores the rotation in d[0..3] and half the translation
+ * multiplied by the rotation in d[4..7]. It composes rigid transforms with
+ * one 8 float multiply and blends them without shearing.
+ */
+
+void dquat_identity(dquat d) {
+
+	quat_identity(&d[0]);
+	d[4] = 0.0f;
+	d[5] = 0.0f;
+	d[6] = 0.0f;
+	d[7] = 0.0f;
+
+}
+
+void dquat_from_rigid(quat r, vec3 t, dquat d) {
+
+	quat pure = { t[0], t[1], t[2], 0.0f };
+
+	quat_copy(r, &d[0]);
+	quat_multiply(pure, r, &d[4]);
+	d[4] *= 0.5f;
+	d[5] *= 0.5f;
+	d[6] *= 0.5f;
+	d[7] *= 0.5f;
+
+}
+
+void dquat_translation(dquat d, vec3 t) {
+
+	quat conj, tmp;
+
+	quat_conjugate(&d[0], conj);
+	quat_multiply(&d[4], conj, tmp);
+
+	t[0] = 2.0f * tmp[0];
+	t[1] = 2.0f * tmp[1];
+	t[2] = 2.0f * tmp[2];
+
+}
+
+void dquat_multiply(dquat a, dquat b, dquat d) {
+
+	quat r, t0, t1;
+
+	quat_multiply(&a[0], &b[0], r);
+	quat_multiply(&a[0], &b[4], t0);
+	quat_multiply(&a[4], &b[0], t1);
+
+	quat_copy(r, &d[0]);
+	d[4] = t0[0] + t1[0];
+	d[5] = t0[1] + t1[1];
+	d[6] = t0[2] + t1[2];
+	d[7] = t0[3] + t1[3];
+
+}
+
+void dquat_normalize(dquat a, dquat d) {
+
+	int i;
+	float p = 1.0f / sqrtf(quat_dot(&a[0], &a[0]));
+
+	for(i = 0; i < 8; i++) {
+		d[i] = a[i] * p;
+	}
+
+}
+
+void dquat_nlerp(dquat a, dquat b, float t, dquat d) {
+
+	int i;
+	float wb = quat_dot(&a[0], &b[0]) < 0.0f ? -t : t;
+	float wa = 1.0f - t;
+
+	for(i = 0; i < 8; i++) {
+		d[i] = a[i]*wa + b[i]*wb;
+	}
+
+	dquat_normalize(d, d);
+
+}
+
+void dquat_transform_point(dquat d, vec3 p, vec3 v) {
+
+	vec3 t;
+	quat pure = { p[0], p[1], p[2], 0.0f };
+	quat conj;
+
+	dquat_translation(d, t);
+	quat_conjugate(&d[0], conj);
+	quat_multiply(&d[0], pure, pure);
+	quat_multiply(pure, conj, pure);
+
+	v[0] = pure[0] + t[0];
+	v[1] = pure[1] + t[1];
+	v[2] = pure[2] + t[2];
+
+}
+
+void mat4_from_dquat(dquat d, mat4 m) {
+
+	vec3 t;
+
+	dquat_translation(d, t);
+	mat4_compose_quat(t, &d[0], NULL, m);
+
+}
+
+/******************************************************************************/
+/** Batch Utils                                                              **/
+/******************************************************************************/
+
+void mat4_multiply_batch(mat4 *a, mat4 *b, mat4 *m, int count) {
+
+	int i;
+
+	if(mat4_multiply_kernel == mat4_multiply_select) {
+		simd_select();
+	}
+
+	for(i = 0; i < count; i++) {
+		mat4_multiply_kernel(a[i], b[i], m[i]);
+	}
+
+}
+
+void mat4_compose_batch(vec3_soa t, vec3_soa r, vec3_soa s, mat4 *m, int count) {
+
+	int i, j, n;
+	float block[BATCH_ROWS][DASH_BATCH];
+
+	for(i = 0; i < count; i += DASH_BATCH) {
+
+		n = count - i < DASH_BATCH ? count - i : DASH_BATCH;
+
+		dash_sincosf_batch(r.x + i, block[BATCH_SX], block[BATCH_CX], n);
+		dash_sincosf_batch(r.y + i, block[BATCH_SY], block[BATCH_CY], n);
+		dash_sincosf_batch(r.z + i, block[BATCH_SZ], block[BATCH_CZ], n);
+
+		for(j = 0; j < n; j++) {
+			block[BATCH_KX][j] = s.x ? s.x[i + j] : 1.0f;
+			block[BATCH_KY][j] = s.y ? s.y[i + j] : 1.0f;
+			block[BATCH_KZ][j] = s.z ? s.z[i + j] : 1.0f;
+			block[BATCH_TX][j] = t.x[i + j];
+			block[BATCH_TY][j] = t.y[i + j];
+			block[BATCH_TZ][j] = t.z[i + j];
+		}
+
+		compose_block_kernel(block, m + i, n);
+
+	}
+
+}
+
+void quat_multiply_batch(quat *a, quat *b, quat *q, int count) {
+
+	int i;
+
+	i = quat_multiply_kernel(a, b, q, count);
+
+	for(; i < count; i++) {
+		quat_multiply(a[i], b[i], q[i]);
+	}
+
+}
+
+void quat_normalize_batch(quat *a, quat *q, int count) {
+
+	int i;
+
+	i = quat_normalize_kernel(a, q, count);
+
+	for(; i < count; i++) {
+		quat_normalize(a[i], q[i]);
+	}
+
+}
+
+void quat_nlerp_batch(quat *a, quat *b, float *t, quat *q, int count) {
+
+	int i;
+
+	i = quat_nlerp_kernel(a, b, t, q, count);
+
+	for(; i < count; i++) {
+		quat_nlerp(a[i], b[i], t[i], q[i]);
+	}
+
+}
+
+void quat_slerp_batch(quat *a, quat *b, float *t, quat *q, int count) {
+
+	int i;
+
+	i = quat_slerp_kernel(a, b, t, q, count);
+
+	for(; i < count; i++) {
+		quat_slerp(a[i], b[i], t[i], q[i]);
+	}
+
+}
+
+void mat4_from_quat_batch(quat *q, mat4 *m, int count) {
+
+	int i;
+
+	i = mat4_from_quat_kernel(q, m, count);
+
+	for(; i < count; i++) {
+		mat4_from_quat(q[i], m[i]);
+	}
+
+}
+
+void dquat_multiply_batch(dquat *a, dquat *b, dquat *d, int count) {
+
+	int i;
+
+	i = dquat_multiply_kernel(a, b, d, count);
+
+	for(; i < count; i++) {
+		dquat_multiply(a[i], b[i], d[i]);
+	}
+
+}
+
+void dquat_nlerp_batch(dquat *a, dquat *b, float *t, dquat *d, int count) {
+
+	int i;
+
+	i = dquat_nlerp_kernel(a, b, t, d, count);
+
+	for(; i < count; i++) {
+		dquat_nlerp(a[i], b[i], t[i], d[i]);
+	}
+
+}
+
+void mat4_from_dquat_batch(dquat *d, mat4 *m, int count) {
+
+	int i;
+
+	i = mat4_from_dquat_kernel(d, m, count);
+
+	for(; i < count; i++) {
+		mat4_from_dquat(d[i], m[i]);
+	}
 
 }
 
@@ -24,12 +24,118 @@
 #ifndef DASHGL_UTILS
 #define DASHGL_UTILS
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 	/**********************************************************************/
 	/** Typedef                                                          **/	
 	/**********************************************************************/
 
 	typedef float mat4[16];
+	typedef float mat3[9];
 	typedef float vec3[3];
+	typedef float quat[4];
+	typedef float dquat[8];
+	typedef float frustum[6][4];
+
+	typedef struct {
+		float *x;
+		float *y;
+		float *z;
+	} vec3_soa;
+
+	typedef struct {
+		mat4 projection;
+		mat4 view;
+		mat4 view_projection;
+		frustum planes;
+	} camera;
+
+	typedef struct {
+		int state;
+		int cached;
+		GLuint program;
+		GLuint vertex;
+		GLuint fragment;
+		const char *vertex_name;
+		const char *fragment_name;
+		unsigned long long key;
+		double start;
+	} program_request;
+
+	typedef struct {
+		int fd;
+		int changed;
+		int building;
+		const char *vertex;
+		const char *fragment;
+		const char **defines;
+		GLuint program;
+		GLuint candidate;
+		GLuint vertex_shader;
+		GLuint fragment_shader;
+		program_request request;
+	} shader_reload;
+
+	typedef struct {
+		char name[64];
+		GLint location;
+		GLenum type;
+		GLint size;
+		unsigned int hash;
+		int set;
+		unsigned char value[64];
+	} program_variable;
+
+	typedef struct {
+		GLuint program;
+		int uniform_count;
+		int attribute_count;
+		program_variable *uniforms;
+		program_variable *attributes;
+		int *uniform_table;
+		int *attribute_table;
+		int uniform_mask;
+		int attribute_mask;
+		unsigned int uploads;
+		unsigned int skipped;
+	} program_reflection;
+
+	typedef struct {
+		GLuint program;
+		GLuint vao;
+		GLenum blend_src;
+		GLenum blend_dst;
+		double ms;
+	} warmup_entry;
+
+	typedef struct {
+		int count;
+		int capacity;
+		warmup_entry *entries;
+	} warmup_list;
+
+	typedef struct {
+		int hits;
+		int misses;
+		int rejected;
+		double hit_ms;
+		double miss_ms;
+	} program_cache_stats;
+
+	typedef struct {
+		int count;
+		int capacity;
+		unsigned int frame;
+		int *parent;
+		vec3 *translation;
+		quat *rotation;
+		vec3 *scale;
+		mat4 *world;
+		unsigned int *updated;
+		unsigned char *dirty;
+	} transform_tree;
 
 	/**********************************************************************/
 	/** Constants                                                        **/	
@@ -52,6 +158,43 @@
 	#define M_23 14
 	#define M_33 15
 
+	#define DASH_CPU_SSE2 0x01
+	#define DASH_CPU_AVX2 0x02
+	#define DASH_CPU_NEON 0x04
+	#define DASH_CPU_F16C 0x08
+
+	#define DASH_TRIG_EXACT 0
+	#define DASH_TRIG_FAST 1
+
+	#define DASH_ATTRIB_FLOAT 0
+	#define DASH_ATTRIB_HALF 1
+	#define DASH_ATTRIB_SNORM8 2
+	#define DASH_ATTRIB_UNORM8 3
+	#define DASH_ATTRIB_SNORM16 4
+	#define DASH_ATTRIB_UNORM16 5
+	#define DASH_ATTRIB_SNORM_2_10_10_10 6
+	#define DASH_ATTRIB_UNORM_2_10_10_10 7
+
+	#define DASH_MIPMAP_NONE 0
+	#define DASH_MIPMAP_GENERATE 1
+	#define DASH_MIPMAP_CPU 2
+
+	#define DASH_IMAGE_FLIP_Y 1
+	#define DASH_IMAGE_PREMULTIPLY 2
+	#define DASH_IMAGE_SWAP_RB 4
+
+	#define DASH_PROGRAM_FAILED -1
+	#define DASH_PROGRAM_PENDING 0
+	#define DASH_PROGRAM_READY 1
+
+	/**********************************************************************/
+	/** CPU Dispatch                                                     **/	
+	/**********************************************************************/
+
+	int dash_cpu_features();
+	void dash_cpu_override(int features);
+	const char *dash_simd_name();
+
 	/**********************************************************************/
 	/** Shader Utilities                                                 **/	
 	/**********************************************************************/
@@ -59,8 +202,53 @@
 	GLuint dash_create_shader(const char *filename, GLenum type);
 	void dash_print_log(GLuint object);
 	GLuint dash_create_program(const char *vertex, const char *fragment);
+	GLuint dash_create_program_variant(const char *vertex, const char *fragment, const char **defines);
+	void dash_shader_cache_clear();
+	void dash_program_cache(const char *directory);
+	void dash_program_cache_stats(program_cache_stats *stats);
+	int dash_program_submit(const char *vertex, const char *fragment, const char **defines, program_request *req);
+	int dash_program_poll(program_request *req);
+	GLuint dash_program_wait(program_request *req);
+	int dash_shader_watch(const char *vertex, const char *fragment, const char **defines, GLuint program, shader_reload *r);
+	int dash_shader_reload(shader_reload *r);
+	void dash_shader_accept(shader_reload *r, int accept);
+	void dash_shader_unwatch(shader_reload *r);
+	int dash_program_reflect(GLuint program, program_reflection *r);
+	void dash_program_reflection_free(program_reflection *r);
+	int dash_uniform_index(program_reflection *r, const char *name);
+	GLint dash_uniform_location(program_reflection *r, const char *name);
+	GLint dash_attrib_location(program_reflection *r, const char *name);
+	void dash_uniform_1i(program_reflection *r, int index, GLint value);
+	void dash_uniform_1f(program_reflection *r, int index, GLfloat value);
+	void dash_uniform_3fv(program_reflection *r, int index, const GLfloat *value);
+	void dash_uniform_4fv(program_reflection *r, int index, const GLfloat *value);
+	void dash_uniform_matrix4fv(program_reflection *r, int index, const GLfloat *value);
+	int dash_warmup_add(warmup_list *w, GLuint program, GLuint vao, GLenum blend_src, GLenum blend_dst);
+	double dash_warmup_run(warmup_list *w);
+	void dash_warmup_free(warmup_list *w);
 	GLuint dash_texture_load(const char *filename);
+	void dash_texture_mipmaps(int mode);
+	void dash_texture_transform(int flags);
+	int dash_texture_cook(const char *source, const char *filename);
+	GLuint dash_texture_load_cooked(const char *filename);
+	GLuint dash_texture_acquire(const char *filename);
+	void dash_texture_release(GLuint texture);
+	int dash_texture_ready(GLuint texture);
+	size_t dash_texture_memory();
+	int dash_texture_stream_init(int threads, size_t budget);
+	GLuint dash_texture_load_async(const char *filename);
+	int dash_texture_stream_update();
+	int dash_texture_stream_pending();
+	void dash_texture_stream_shutdown();
 	
+	/**********************************************************************/
+	/** Trig Utilities                                                   **/	
+	/**********************************************************************/
+
+	void dash_trig_accuracy(int accuracy);
+	void dash_sincosf(float x, float *s, float *c);
+	void dash_sincosf_batch(const float *x, float *s, float *c, int count);
+
 	/**********************************************************************/
 	/** Vector3 Utilities                                                **/	
 	/**********************************************************************/
@@ -80,9 +268,122 @@
 	void mat4_rotate_y(float y, mat4 m);
 	void mat4_rotate_z(float z, mat4 m);
 	void mat4_multiply(mat4 a, mat4 b, mat4 m);
+	void mat4_multiply_scalar(mat4 a, mat4 b, mat4 m);
 	void mat4_rotate(vec3 r, mat4 m);
+	void mat4_compose(vec3 t, vec3 r, vec3 s, mat4 m);
 	void mat4_look_at(vec3 eye, vec3 center, vec3 up, mat4 m);
 	void mat4_perspective(float y_fov, float aspect, float n, float f, mat4 m);
 	void mat4_orthographic(int left, int right, int top, int bottom, mat4 m);
 
+	/**********************************************************************/
+	/** Inverse Utilities                                                **/	
+	/**********************************************************************/
+
+	int mat4_inverse(mat4 a, mat4 m);
+	int mat4_inverse_affine(mat4 a, mat4 m);
+	void mat4_inverse_rigid(mat4 a, mat4 m);
+	int mat3_normal(mat4 a, mat3 n);
+
+	/**********************************************************************/
+	/** Frustum Utilities                                                **/	
+	/**********************************************************************/
+
+	void frustum_from_mat4(mat4 vp, frustum f);
+	int frustum_cull_spheres(frustum f, vec3_soa center, float *radius, int count, int *visible);
+	int frustum_cull_aabbs(frustum f, vec3_soa min, vec3_soa max, int count, int *visible);
+
+	/**********************************************************************/
+	/** Camera Utilities                                                 **/	
+	/**********************************************************************/
+
+	void camera_update(camera *c);
+	void camera_mvp(camera *c, mat4 model, mat4 m);
+	void camera_mvp_batch(camera *c, mat4 *model, mat4 *m, int count);
+
+	/**********************************************************************/
+	/** Transform Utilities                                              **/	
+	/**********************************************************************/
+
+	int transform_tree_init(transform_tree *t, int capacity);
+	void transform_tree_free(transform_tree *t);
+	int transform_add(transform_tree *t, int parent);
+	void transform_set_translation(transform_tree *t, int node, vec3 v);
+	void transform_set_rotation(transform_tree *t, int node, quat q);
+	void transform_set_scale(transform_tree *t, int node, vec3 s);
+	int transform_update(transform_tree *t);
+
+	/**********************************************************************/
+	/** Vertex Format Utilities                                          **/	
+	/**********************************************************************/
+
+	unsigned short dash_float_to_half(float f);
+	float dash_half_to_float(unsigned short h);
+	short dash_float_to_snorm16(float f);
+	unsigned short dash_float_to_unorm16(float f);
+	signed char dash_float_to_snorm8(float f);
+	unsigned char dash_float_to_unorm8(float f);
+	unsigned int dash_pack_snorm_2_10_10_10(float x, float y, float z, float w);
+	unsigned int dash_pack_unorm_2_10_10_10(float x, float y, float z, float w);
+	void dash_float_to_half_batch(const float *src, unsigned short *dst, int count);
+	void dash_half_to_float_batch(const unsigned short *src, float *dst, int count);
+	void dash_float_to_snorm16_batch(const float *src, short *dst, int count);
+	void dash_float_to_unorm16_batch(const float *src, unsigned short *dst, int count);
+	void dash_float_to_snorm8_batch(const float *src, signed char *dst, int count);
+	void dash_float_to_unorm8_batch(const float *src, unsigned char *dst, int count);
+	void dash_pack_snorm_2_10_10_10_batch(const float *src, unsigned int *dst, int count);
+	void dash_pack_unorm_2_10_10_10_batch(const float *src, unsigned int *dst, int count);
+	int dash_vertex_attrib(GLint location, GLint size, int format, GLsizei stride, size_t offset);
+
+	/**********************************************************************/
+	/** Image Utilities                                                  **/	
+	/**********************************************************************/
+
+	void dash_image_downsample(const unsigned char *src, int width, int height, int channels, unsigned char *dst);
+	void dash_image_transform(unsigned char *data, int width, int height, int channels, int flags);
+
+	/**********************************************************************/
+	/** Quaternion Utilities                                             **/	
+	/**********************************************************************/
+
+	void quat_identity(quat q);
+	void quat_copy(quat a, quat q);
+	void quat_from_axis_angle(vec3 axis, float angle, quat q);
+	void quat_from_euler(vec3 r, quat q);
+	void quat_multiply(quat a, quat b, quat q);
+	void quat_conjugate(quat a, quat q);
+	float quat_dot(quat a, quat b);
+	void quat_normalize(quat a, quat q);
+	void quat_nlerp(quat a, quat b, float t, quat q);
+	void quat_slerp(quat a, quat b, float t, quat q);
+	void mat4_from_quat(quat q, mat4 m);
+	void mat4_compose_quat(vec3 t, quat q, vec3 s, mat4 m);
+
+	void dquat_identity(dquat d);
+	void dquat_from_rigid(quat r, vec3 t, dquat d);
+	void dquat_translation(dquat d, vec3 t);
+	void dquat_multiply(dquat a, dquat b, dquat d);
+	void dquat_normalize(dquat a, dquat d);
+	void dquat_nlerp(dquat a, dquat b, float t, dquat d);
+	void dquat_transform_point(dquat d, vec3 p, vec3 v);
+	void mat4_from_dquat(dquat d, mat4 m);
+
+	/**********************************************************************/
+	/** Batch Utilities                                                  **/	
+	/**********************************************************************/
+
+	void mat4_multiply_batch(mat4 *a, mat4 *b, mat4 *m, int count);
+	void mat4_compose_batch(vec3_soa t, vec3_soa r, vec3_soa s, mat4 *m, int count);
+	void quat_multiply_batch(quat *a, quat *b, quat *q, int count);
+	void quat_normalize_batch(quat *a, quat *q, int count);
+	void quat_nlerp_batch(quat *a, quat *b, float *t, quat *q, int count);
+	void quat_slerp_batch(quat *a, quat *b, float *t, quat *q, int count);
+	void mat4_from_quat_batch(quat *q, mat4 *m, int count);
+	void dquat_multiply_batch(dquat *a, dquat *b, dquat *d, int count);
+	void dquat_nlerp_batch(dquat *a, dquat *b, float *t, dquat *d, int count);
+	void mat4_from_dquat_batch(dquat *d, mat4 *m, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
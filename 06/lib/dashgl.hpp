@@ -0,0 +1,381 @@
+/*
+
+    This file is part of Dash Graphics Library
+    Copyright 2017 Benjamin Collins
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy of this
+    software and associated documentation files (the "Software"), to deal in the Software
+    without restriction, including without limitation the rights to use, copy, modify, merge,
+    publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+    to whom the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all copies or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+    INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+    PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE
+    FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+    OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+
+*/
+
+/*
+ * Header-only C++14 layer over the dashgl vector and matrix types. Every
+ * function is inline and constexpr, so constant matrices such as the
+ * projection and camera can be built at compile time, and per-frame math is
+ * inlined into the caller instead of crossing into dashgl.o.
+ *
+ * dash::vec3 and dash::mat4 have exactly the layout of vec3 and mat4, so
+ * they convert to float* and can be handed to glUniformMatrix4fv or to any
+ * of the C functions in dashgl.h. Include GL/glew.h first, as with dashgl.h.
+ *
+ *	constexpr dash::mat4 projection = dash::perspective(45.0f, 4.0f/3.0f, 0.1f, 10.0f);
+ *	glUniformMatrix4fv(uniform_perspective, 1, GL_FALSE, projection);
+ *
+ * sqrt, sin, cos and tan need __builtin_is_constant_evaluated (GCC 9, Clang
+ * 9) to pick the series at compile time and libm at runtime. Without it they
+ * always take the runtime path and, with the functions built on them, are
+ * plain inline rather than constexpr. make hpp checks the header builds.
+ */
+
+#if !defined(__cplusplus) || __cplusplus < 201402L
+#error "dashgl.hpp needs C++14 or later"
+#endif
+
+#ifndef DASHGL_HPP
+#define DASHGL_HPP
+
+#include <cmath>
+#include <type_traits>
+#include "dashgl.h"
+
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define DASH_HAS_CONSTANT_EVALUATED
+#endif
+#endif
+
+// GCC 9 has the builtin but not __has_builtin
+#if !defined(DASH_HAS_CONSTANT_EVALUATED) && defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 9
+#define DASH_HAS_CONSTANT_EVALUATED
+#endif
+
+// Functions that reach sqrt, sin, cos or tan are constexpr only when the
+// builtin can send constant evaluation down the series
+#ifdef DASH_HAS_CONSTANT_EVALUATED
+#define DASH_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#define DASH_MATH_CONSTEXPR constexpr
+#else
+#define DASH_CONSTANT_EVALUATED() false
+#define DASH_MATH_CONSTEXPR inline
+#endif
+
+namespace dash {
+
+	/**********************************************************************/
+	/** Types                                                            **/
+	/**********************************************************************/
+
+	struct vec3 {
+
+		float v[3];
+
+		constexpr float &operator[](int i) { return v[i]; }
+		constexpr const float &operator[](int i) const { return v[i]; }
+		operator float*() { return v; }
+		operator const float*() const { return v; }
+
+	};
+
+	struct mat4 {
+
+		float m[16];
+
+		constexpr float &operator[](int i) { return m[i]; }
+		constexpr const float &operator[](int i) const { return m[i]; }
+		operator float*() { return m; }
+		operator const float*() const { return m; }
+
+	};
+
+	static_assert(sizeof(dash::vec3) == sizeof(::vec3), "dash::vec3 must match vec3");
+	static_assert(sizeof(dash::mat4) == sizeof(::mat4), "dash::mat4 must match mat4");
+	static_assert(std::is_standard_layout<dash::mat4>::value, "dash::mat4 must be standard layout");
+
+	/**********************************************************************/
+	/** Scalar Math                                                      **/
+	/**********************************************************************/
+
+	namespace detail {
+
+		constexpr double pi = 3.14159265358979323846;
+
+		// Newton iteration, only reached during constant evaluation
+		constexpr double sqrt_series(double x) {
+
+			double r = 0.0, last = 0.0;
+
+			if(x <= 0.0) {
+				return 0.0;
+			}
+
+			r = x > 1.0 ? x : 1.0;
+			last = 0.0;
+			while(r != last) {
+				last = r;
+				r = 0.5 * (r + x / r);
+			}
+
+			return r;
+
+		}
+
+		// Taylor series after reducing to [-pi, pi], good to double precision
+		constexpr void sincos_series(double x, double &s, double &c) {
+
+			int i = 0;
+			double k = 0.0, term_s = 0.0, term_c = 0.0, x2 = 0.0;
+
+			k = x / (2.0 * pi);
+			k = (double)(long long)(k < 0.0 ? k - 0.5 : k + 0.5);
+			x -= k * 2.0 * pi;
+			x2 = x * x;
+
+			s = term_s = x;
+			c = term_c = 1.0;
+			for(i = 1; i < 14; i++) {
+				term_s *= -x2 / ((2 * i) * (2 * i + 1));
+				term_c *= -x2 / ((2 * i - 1) * (2 * i));
+				s += term_s;
+				c += term_c;
+			}
+
+		}
+
+	}
+
+	DASH_MATH_CONSTEXPR float sqrt(float x) {
+
+		if(DASH_CONSTANT_EVALUATED()) {
+			return (float)detail::sqrt_series(x);
+		}
+		return std::sqrt(x);
+
+	}
+
+	DASH_MATH_CONSTEXPR void sincos(float x, float &s, float &c) {
+
+		double ds = 0.0, dc = 0.0;
+
+		if(DASH_CONSTANT_EVALUATED()) {
+			detail::sincos_series(x, ds, dc);
+			s = (float)ds;
+			c = (float)dc;
+			return;
+		}
+		dash_sincosf(x, &s, &c);
+
+	}
+
+	DASH_MATH_CONSTEXPR float tan(float x) {
+
+		double ds = 0.0, dc = 0.0;
+
+		if(DASH_CONSTANT_EVALUATED()) {
+			detail::sincos_series(x, ds, dc);
+			return (float)(ds / dc);
+		}
+		return (float)std::tan(x);
+
+	}
+
+	/**********************************************************************/
+	/** Vector3 Utilities                                                **/
+	/**********************************************************************/
+
+	constexpr vec3 operator+(const vec3 &a, const vec3 &b) {
+		return vec3{{ a[0] + b[0], a[1] + b[1], a[2] + b[2] }};
+	}
+
+	constexpr vec3 operator-(const vec3 &a, const vec3 &b) {
+		return vec3{{ a[0] - b[0], a[1] - b[1], a[2] - b[2] }};
+	}
+
+	constexpr vec3 operator-(const vec3 &a) {
+		return vec3{{ -a[0], -a[1], -a[2] }};
+	}
+
+	constexpr vec3 operator*(const vec3 &a, float k) {
+		return vec3{{ a[0] * k, a[1] * k, a[2] * k }};
+	}
+
+	constexpr float dot(const vec3 &a, const vec3 &b) {
+		return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+	}
+
+	constexpr vec3 cross(const vec3 &a, const vec3 &b) {
+		return vec3{{
+			a[1]*b[2] - a[2]*b[1],
+			a[2]*b[0] - a[0]*b[2],
+			a[0]*b[1] - a[1]*b[0]
+		}};
+	}
+
+	DASH_MATH_CONSTEXPR float length(const vec3 &a) {
+		return dash::sqrt(dot(a, a));
+	}
+
+	DASH_MATH_CONSTEXPR vec3 normalize(const vec3 &a) {
+		return a * (1.0f / length(a));
+	}
+
+	/**********************************************************************/
+	/** Matrix Utilities                                                 **/
+	/**********************************************************************/
+
+	constexpr mat4 identity() {
+		return mat4{{
+			1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		}};
+	}
+
+	constexpr mat4 translate(const vec3 &t) {
+		return mat4{{
+			1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			t[0], t[1], t[2], 1.0f
+		}};
+	}
+
+	constexpr mat4 scale(const vec3 &s) {
+		return mat4{{
+			s[0], 0.0f, 0.0f, 0.0f,
+			0.0f, s[1], 0.0f, 0.0f,
+			0.0f, 0.0f, s[2], 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		}};
+	}
+
+	DASH_MATH_CONSTEXPR mat4 rotate_x(float x) {
+
+		float s = 0.0f, c = 0.0f;
+		dash::sincos(x, s, c);
+
+		return mat4{{
+			1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f,    c,    s, 0.0f,
+			0.0f,   -s,    c, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		}};
+
+	}
+
+	DASH_MATH_CONSTEXPR mat4 rotate_y(float y) {
+
+		float s = 0.0f, c = 0.0f;
+		dash::sincos(y, s, c);
+
+		return mat4{{
+			   c, 0.0f,   -s, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			   s, 0.0f,    c, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		}};
+
+	}
+
+	DASH_MATH_CONSTEXPR mat4 rotate_z(float z) {
+
+		float s = 0.0f, c = 0.0f;
+		dash::sincos(z, s, c);
+
+		return mat4{{
+			   c,    s, 0.0f, 0.0f,
+			  -s,    c, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		}};
+
+	}
+
+	constexpr mat4 operator*(const mat4 &a, const mat4 &b) {
+
+		int r = 0, c = 0, k = 0;
+		mat4 m = {};
+
+		for(c = 0; c < 4; c++) {
+			for(r = 0; r < 4; r++) {
+				for(k = 0; k < 4; k++) {
+					m[c*4 + r] += a[k*4 + r] * b[c*4 + k];
+				}
+			}
+		}
+
+		return m;
+
+	}
+
+	// Same result as mat4_compose: T * Rx * Ry * Rz * S
+	DASH_MATH_CONSTEXPR mat4 compose(const vec3 &t, const vec3 &r, const vec3 &s = vec3{{ 1.0f, 1.0f, 1.0f }}) {
+
+		float cx = 0.0f, sx = 0.0f, cy = 0.0f, sy = 0.0f, cz = 0.0f, sz = 0.0f;
+
+		dash::sincos(r[0], sx, cx);
+		dash::sincos(r[1], sy, cy);
+		dash::sincos(r[2], sz, cz);
+
+		return mat4{{
+			cy*cz * s[0], (sx*sy*cz + cx*sz) * s[0], (sx*sz - cx*sy*cz) * s[0], 0.0f,
+			-cy*sz * s[1], (cx*cz - sx*sy*sz) * s[1], (cx*sy*sz + sx*cz) * s[1], 0.0f,
+			sy * s[2], -sx*cy * s[2], cx*cy * s[2], 0.0f,
+			t[0], t[1], t[2], 1.0f
+		}};
+
+	}
+
+	// Same result as mat4_look_at, without negating eye in place
+	DASH_MATH_CONSTEXPR mat4 look_at(const vec3 &eye, const vec3 &center, const vec3 &up) {
+
+		vec3 f = normalize(center - eye);
+		vec3 s = normalize(cross(f, up));
+		vec3 t = cross(s, f);
+
+		return mat4{{
+			s[0], t[0], -f[0], 0.0f,
+			s[1], t[1], -f[1], 0.0f,
+			s[2], t[2], -f[2], 0.0f,
+			-dot(s, eye), -dot(t, eye), dot(f, eye), 1.0f
+		}};
+
+	}
+
+	DASH_MATH_CONSTEXPR mat4 perspective(float y_fov, float aspect, float n, float f) {
+
+		float a = 1.0f / dash::tan(y_fov / 2.0f);
+
+		return mat4{{
+			a / aspect, 0.0f, 0.0f, 0.0f,
+			0.0f, a, 0.0f, 0.0f,
+			0.0f, 0.0f, -((f + n) / (f - n)), -1.0f,
+			0.0f, 0.0f, -((2.0f * f * n) / (f - n)), 0.0f
+		}};
+
+	}
+
+	constexpr vec3 transform_point(const mat4 &m, const vec3 &p) {
+		return vec3{{
+			m[M_00]*p[0] + m[M_01]*p[1] + m[M_02]*p[2] + m[M_03],
+			m[M_10]*p[0] + m[M_11]*p[1] + m[M_12]*p[2] + m[M_13],
+			m[M_20]*p[0] + m[M_21]*p[1] + m[M_22]*p[2] + m[M_23]
+		}};
+	}
+
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <GL/glew.h>
 #include "SDL.h"
 #include "lib/dashgl.h"
@@ -7,13 +8,29 @@
 #define WIDTH 800
 #define HEIGHT 600
 
+// SNORM16 position and UNORM16 texcoord, 12 bytes instead of 5 floats
+typedef struct {
+	GLshort position[4];
+	GLushort texcoord[2];
+} packed_vertex;
+
 GLuint program;
 GLint attribute_coord3d, attribute_texcoord;
 GLuint texture_id, vbo_cube_vertices, ibo_cube_elements;
-GLint uniform_perspective, uniform_lookat, uniform_mvp;
-GLint uniform_mytexture;
+// Indices into program_vars, not GL locations
+int uniform_mvp;
+int uniform_mytexture;
+program_reflection program_vars;
+shader_reload shader_watch;
+camera view_camera;
+int visible[1], visible_count;
+transform_tree scene;
+int cube_node;
 
 bool init_resources();
+bool bind_program(GLuint candidate);
+void bind_vertices();
+void warmup();
 void render(SDL_Window*);
 void logic();
 void free_resources();
@@ -61,8 +78,9 @@ int main(int argc, char *argv[]) {
 
 	glEnable(GL_BLEND);
 	glEnable(GL_DEPTH_TEST);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
+	warmup();
 	main_loop(window);
 	free_resources();
 
@@ -72,6 +90,9 @@ int main(int argc, char *argv[]) {
 
 bool init_resources() {
 
+	int i, j;
+	packed_vertex packed_vertices[24];
+
 	GLfloat cube_vertices[] = {
 		// front
 		-1.0, -1.0,  1.0, 0.0, 0.0,
@@ -126,12 +147,21 @@ bool init_resources() {
 		22, 23, 20
 	};
 
+	for(i = 0; i < 24; i++) {
+		for(j = 0; j < 3; j++) {
+			packed_vertices[i].position[j] = dash_float_to_snorm16(cube_vertices[i*5 + j]);
+		}
+		packed_vertices[i].position[3] = 0;
+		packed_vertices[i].texcoord[0] = dash_float_to_unorm16(cube_vertices[i*5 + 3]);
+		packed_vertices[i].texcoord[1] = dash_float_to_unorm16(cube_vertices[i*5 + 4]);
+	}
+
 	glGenBuffers(1, &vbo_cube_vertices);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo_cube_vertices);
 	glBufferData(
 		GL_ARRAY_BUFFER,
-		sizeof(cube_vertices),
-		cube_vertices,
+		sizeof(packed_vertices),
+		packed_vertices,
 		GL_STATIC_DRAW
 	);
 
@@ -144,71 +174,94 @@ bool init_resources() {
 		GL_STATIC_DRAW
 	);
 
+	program_cache_stats stats;
+
+	dash_program_cache("cache");
 	program = dash_create_program("sdr/vertex.glsl", "sdr/fragment.glsl");
 	if(program == 0) {
 		fprintf(stderr, "Program creation error\n");
 		return false;
 	}
 
-	glLinkProgram(program);
+	dash_program_cache_stats(&stats);
+	printf("program cache: %d hit %.2f ms, %d miss %.2f ms\n",
+		stats.hits, stats.hit_ms, stats.misses, stats.miss_ms);
 
-	texture_id = dash_texture_load("tex/RTS_Crate.png");
+	// Decoded on a worker thread; a placeholder is drawn until it arrives.
+	// Flipped and premultiplied at load, for the shader and the blend func
+	dash_texture_stream_init(2, 4 << 20);
+	dash_texture_transform(DASH_IMAGE_FLIP_Y | DASH_IMAGE_PREMULTIPLY);
+	texture_id = dash_texture_load_async("tex/RTS_Crate.png");
+	dash_shader_watch("sdr/vertex.glsl", "sdr/fragment.glsl", NULL, program, &shader_watch);
 
-	const char *attribute_name = "coord3d";
-	attribute_coord3d = glGetAttribLocation(program, attribute_name);
-	if(attribute_coord3d == -1) {
-		fprintf(stderr, "Could not bind attribute %s\n", attribute_name);
+	if(!bind_program(program)) {
 		return false;
 	}
 
-	attribute_name = "texcoord";
-	attribute_texcoord = glGetAttribLocation(program, attribute_name);
-	if(attribute_texcoord == -1) {
-		fprintf(stderr, "Could not bind attribute %s\n", attribute_name);
-		return false;
-	}
+	glClearColor(1.0, 1.0, 1.0, 1.0);
+	
+	vec3 eye = { 0.0f, 2.0f, 0.0f };
+	vec3 target = { 0.0f, 0.0f, -4.0f };
+	vec3 axis = { 0.0f, 1.0f, 0.0f };
+
+	mat4_perspective(45.0f, 1.0f*WIDTH/HEIGHT, 0.1f, 10.0f, view_camera.projection);
+	mat4_look_at(eye, target, axis, view_camera.view);
+	camera_update(&view_camera);
 
-	const char *uniform_name = "mvp";
-	uniform_mvp = glGetUniformLocation(program, uniform_name);
-	if(uniform_mvp == -1) {
-		fprintf(stderr, "Could not bind uniform %s\n", uniform_name);
+	vec3 position = { 0.0f, 0.0f, -4.0f };
+	if(!transform_tree_init(&scene, 1)) {
+		fprintf(stderr, "Could not allocate scene\n");
 		return false;
 	}
+	cube_node = transform_add(&scene, -1);
+	transform_set_translation(&scene, cube_node, position);
 
-	uniform_name = "lookat";
-	uniform_lookat = glGetUniformLocation(program, uniform_name);
-	if(uniform_lookat == -1) {
-		fprintf(stderr, "Could not bind uniform %s\n", uniform_name);
+	return true;
+
+}
+
+// Reflects the program again whenever it changes, e.g. after a reload
+// Looks up everything render needs in candidate and only then makes it
+// current, so a reloaded program missing a name leaves the old one in use
+bool bind_program(GLuint candidate) {
+
+	program_reflection vars;
+	GLint coord3d, texcoord;
+	int mvp, mytexture;
+	const char *missing = NULL;
+
+	if(!dash_program_reflect(candidate, &vars)) {
 		return false;
 	}
 
-	uniform_name = "perspective";
-	uniform_perspective = glGetUniformLocation(program, uniform_name);
-	if (uniform_perspective == -1) {
-		fprintf(stderr, "Could not bind uniform: %s\n", uniform_name);
-		return false;
+	coord3d = dash_attrib_location(&vars, "coord3d");
+	texcoord = dash_attrib_location(&vars, "texcoord");
+	mvp = dash_uniform_index(&vars, "mvp");
+	mytexture = dash_uniform_index(&vars, "mytexture");
+
+	if(coord3d == -1) {
+		missing = "attribute coord3d";
+	} else if(texcoord == -1) {
+		missing = "attribute texcoord";
+	} else if(mvp == -1) {
+		missing = "uniform mvp";
+	} else if(mytexture == -1) {
+		missing = "uniform mytexture";
 	}
 
-	uniform_name = "mytexture";
-	uniform_mytexture = glGetUniformLocation(program, uniform_name);
-	if (uniform_mytexture == -1) {
-		fprintf(stderr, "Could not bind uniform: %s\n", uniform_name);
+	if(missing != NULL) {
+		fprintf(stderr, "Could not bind %s\n", missing);
+		dash_program_reflection_free(&vars);
 		return false;
 	}
 
-	glUseProgram(program);
-	glClearColor(1.0, 1.0, 1.0, 1.0);
-	
-	vec3 eye = { 0.0f, 2.0f, 0.0f };
-	vec3 target = { 0.0f, 0.0f, -4.0f };
-	vec3 axis = { 0.0f, 1.0f, 0.0f };
-
-	mat4 projection, view;
-	mat4_perspective(45.0f, 1.0f*WIDTH/HEIGHT, 0.1f, 10.0f, projection);
-	mat4_look_at(eye, target, axis, view);
-
-	glUniformMatrix4fv(uniform_perspective, 1, GL_FALSE, projection);
-	glUniformMatrix4fv(uniform_lookat, 1, GL_FALSE, view);
+	glUseProgram(candidate);
+	dash_program_reflection_free(&program_vars);
+	program_vars = vars;
+	attribute_coord3d = coord3d;
+	attribute_texcoord = texcoord;
+	uniform_mvp = mvp;
+	uniform_mytexture = mytexture;
 
 	return true;
 
@@ -218,56 +271,92 @@ void logic() {
 
 	float angle = SDL_GetTicks() / 1000.0;
 
-	mat4 mvp, pos, rot;
+	mat4 mvp;
+	quat q;
 
-	vec3 t = { 0.0, 0.0, -4.0f };
+	// Only the rotation changes, so only it is set; the world matrix is
+	// rebuilt by transform_update because the node is now dirty
 	vec3 r = { angle / 2.0f, angle, angle * 3.0f/4.0f };
-	mat4_translate(t, pos);
-	mat4_rotate(r, rot);
+	quat_from_euler(r, q);
+	transform_set_rotation(&scene, cube_node, q);
+	transform_update(&scene);
+	camera_mvp(&view_camera, scene.world[cube_node], mvp);
 
-	mat4_identity(mvp);
-	mat4_multiply(mvp, pos, mvp);
-	mat4_multiply(mvp, rot, mvp);
+	// The cube spans -1 to 1 on each axis, so sqrt(3) bounds any rotation
+	float radius = 1.7321f;
+	float *world = scene.world[cube_node];
+	vec3_soa center = { &world[M_03], &world[M_13], &world[M_23] };
+	visible_count = frustum_cull_spheres(view_camera.planes, center, &radius, 1, visible);
 
-	glUniformMatrix4fv(uniform_mvp, 1, GL_FALSE, mvp);
+	dash_uniform_matrix4fv(&program_vars, uniform_mvp, mvp);
 
 }
 
-void render(SDL_Window *window) {
-	
-	int size;
-	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+// Draws once with the real vertex layout and blend state while loading, so
+// the driver's deferred compile does not land on the first frame
+void warmup() {
 
-	glActiveTexture(GL_TEXTURE0);
-	glUniform1i(uniform_mytexture, /*GL_TEXTURE*/0);
-	glBindTexture(GL_TEXTURE_2D, texture_id);
+	int i;
+	double total;
+	warmup_list list = { 0, 0, NULL };
+
+	dash_warmup_add(&list, program, 0, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	bind_vertices();
+	total = dash_warmup_run(&list);
+	glDisableVertexAttribArray(attribute_coord3d);
+	glDisableVertexAttribArray(attribute_texcoord);
+
+	for(i = 0; i < list.count; i++) {
+		printf("warm-up program %u: %.2f ms\n", list.entries[i].program, list.entries[i].ms);
+	}
+	printf("warm-up total: %.2f ms\n", total);
+
+	dash_warmup_free(&list);
+
+}
+
+void bind_vertices() {
 
 	glEnableVertexAttribArray(attribute_coord3d);
 	glEnableVertexAttribArray(attribute_texcoord);
 
 	glBindBuffer(GL_ARRAY_BUFFER, vbo_cube_vertices);
 
-	glVertexAttribPointer(
+	dash_vertex_attrib(
 		attribute_coord3d,
 		3,
-		GL_FLOAT,
-		GL_FALSE,
-		sizeof(float)*5,
-		0
+		DASH_ATTRIB_SNORM16,
+		sizeof(packed_vertex),
+		offsetof(packed_vertex, position)
 	);
 
-	glVertexAttribPointer(
+	dash_vertex_attrib(
 		attribute_texcoord,
 		2,
-		GL_FLOAT,
-		GL_FALSE,
-		sizeof(float)*5,
-		(void*)(sizeof(float) * 3)
+		DASH_ATTRIB_UNORM16,
+		sizeof(packed_vertex),
+		offsetof(packed_vertex, texcoord)
 	);
 
+}
+
+void render(SDL_Window *window) {
+	
+	int i, size;
+	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+
+	glActiveTexture(GL_TEXTURE0);
+	dash_uniform_1i(&program_vars, uniform_mytexture, /*GL_TEXTURE*/0);
+	glBindTexture(GL_TEXTURE_2D, texture_id);
+
+	bind_vertices();
+
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_cube_elements);
 	glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
-	glDrawElements(GL_TRIANGLES, size/sizeof(GLushort), GL_UNSIGNED_SHORT, 0);
+	for(i = 0; i < visible_count; i++) {
+		glDrawElements(GL_TRIANGLES, size/sizeof(GLushort), GL_UNSIGNED_SHORT, 0);
+	}
 
 	glDisableVertexAttribArray(attribute_coord3d);
 	glDisableVertexAttribArray(attribute_texcoord);
@@ -277,9 +366,17 @@ void render(SDL_Window *window) {
 
 void free_resources() {
 	
+	printf("uniform uploads: %u sent, %u skipped\n", program_vars.uploads, program_vars.skipped);
+	dash_program_reflection_free(&program_vars);
+	dash_texture_stream_shutdown();
+	printf("texture memory: %.1f KiB\n", dash_texture_memory() / 1024.0);
+	dash_texture_release(texture_id);
+	dash_shader_unwatch(&shader_watch);
 	glDeleteProgram(program);
+	dash_shader_cache_clear();
 	glDeleteBuffers(1, &vbo_cube_vertices);
 	glDeleteBuffers(1, &ibo_cube_elements);
+	transform_tree_free(&scene);
 
 }
 
@@ -296,6 +393,14 @@ void main_loop(SDL_Window *window) {
 
 		}
 
+		// Swap in edited shaders once they build and bind; keep the old ones
+		// otherwise
+		if(dash_shader_reload(&shader_watch)) {
+			dash_shader_accept(&shader_watch, bind_program(shader_watch.candidate));
+			program = shader_watch.program;
+		}
+
+		dash_texture_stream_update();
 		logic();
 		render(window);
 	}
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <GL/glew.h>
+#include "SDL.h"
+#include "lib/dashgl.h"
+
+// Texture sampling cost by distance: a screen filling quad is drawn with
+// its texture repeated more times at each step, the way a far away surface
+// maps more texels to each pixel. The crate is drawn without mipmaps and
+// with the trilinear mip chain dash_texture_load now builds.
+
+#define WIDTH 256
+#define HEIGHT 256
+#define LAYERS 16
+#define FRAMES 20
+
+GLuint program, texture_flat, texture_mipmapped;
+GLuint vbo_quad;
+program_reflection program_vars;
+
+bool init_resources();
+void set_repeat(float repeat);
+double draw(GLuint texture);
+void free_resources();
+
+int main(int argc, char *argv[]) {
+
+	int i;
+	double flat_ms, mipmapped_ms;
+	static const float distances[] = { 1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 32.0f };
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window *window = SDL_CreateWindow(
+		"Sampling Benchmark",
+		SDL_WINDOWPOS_CENTERED,
+		SDL_WINDOWPOS_CENTERED,
+		WIDTH,
+		HEIGHT,
+		SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL
+	);
+
+	if(window == NULL) {
+		fprintf(stderr, "Error can't create window %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+
+	if(SDL_GL_CreateContext(window) == NULL) {
+		fprintf(stderr, "Error can't create context %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	GLenum glew_status = glewInit();
+	if(glew_status != GLEW_OK) {
+		fprintf(stderr, "Error glewInit: %s\n", glewGetErrorString(glew_status));
+		exit(1);
+	}
+
+	if(!init_resources()) {
+		exit(1);
+	}
+
+	printf("renderer: %s\n", glGetString(GL_RENDERER));
+	printf("%-10s %14s %14s %10s\n", "texels/px", "linear ms", "trilinear ms", "speedup");
+
+	for(i = 0; i < (int)(sizeof(distances) / sizeof(float)); i++) {
+		set_repeat(distances[i]);
+
+		// First pass of each warms up the texture and shader state
+		draw(texture_flat);
+		flat_ms = draw(texture_flat);
+		draw(texture_mipmapped);
+		mipmapped_ms = draw(texture_mipmapped);
+
+		// The 512 texel crate over 256 pixels is already 2 texels per pixel
+		printf("%-10.0f %14.2f %14.2f %9.2fx\n", distances[i] * 2.0f, flat_ms, mipmapped_ms, flat_ms / mipmapped_ms);
+	}
+
+	free_resources();
+	return 0;
+
+}
+
+bool init_resources() {
+
+	program = dash_create_program("sdr/vertex.glsl", "sdr/fragment.glsl");
+	if(program == 0 || !dash_program_reflect(program, &program_vars)) {
+		fprintf(stderr, "Program creation error\n");
+		return false;
+	}
+
+	dash_texture_mipmaps(DASH_MIPMAP_NONE);
+	texture_flat = dash_texture_load("tex/RTS_Crate.png");
+	dash_texture_mipmaps(DASH_MIPMAP_GENERATE);
+	texture_mipmapped = dash_texture_load("tex/RTS_Crate.png");
+
+	glGenBuffers(1, &vbo_quad);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_quad);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 5 * 6, NULL, GL_DYNAMIC_DRAW);
+
+	GLint coord3d = dash_attrib_location(&program_vars, "coord3d");
+	GLint texcoord = dash_attrib_location(&program_vars, "texcoord");
+
+	glUseProgram(program);
+	glEnableVertexAttribArray(coord3d);
+	glVertexAttribPointer(coord3d, 3, GL_FLOAT, GL_FALSE, sizeof(float)*5, 0);
+	glEnableVertexAttribArray(texcoord);
+	glVertexAttribPointer(
+		texcoord,
+		2,
+		GL_FLOAT,
+		GL_FALSE,
+		sizeof(float)*5,
+		(void*)(sizeof(float) * 3)
+	);
+
+	mat4 identity;
+	mat4_identity(identity);
+	dash_uniform_matrix4fv(&program_vars, dash_uniform_index(&program_vars, "mvp"), identity);
+	dash_uniform_1i(&program_vars, dash_uniform_index(&program_vars, "mytexture"), 0);
+
+	return true;
+
+}
+
+// Screen filling quad with the texture repeated the given number of times
+void set_repeat(float repeat) {
+
+	float quad[] = {
+		-1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+		 1.0f, -1.0f, 0.0f, repeat, 0.0f,
+		 1.0f,  1.0f, 0.0f, repeat, repeat,
+		 1.0f,  1.0f, 0.0f, repeat, repeat,
+		-1.0f,  1.0f, 0.0f, 0.0f, repeat,
+		-1.0f, -1.0f, 0.0f, 0.0f, 0.0f
+	};
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_quad);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(quad), quad);
+
+}
+
+// LAYERS overlapping quads per frame so sampling dominates the frame time
+double draw(GLuint texture) {
+
+	int f, i;
+	Uint64 start;
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glFinish();
+	start = SDL_GetPerformanceCounter();
+
+	for(f = 0; f < FRAMES; f++) {
+		glClear(GL_COLOR_BUFFER_BIT);
+		for(i = 0; i < LAYERS; i++) {
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+		}
+		glFinish();
+	}
+
+	return (SDL_GetPerformanceCounter() - start) * 1e3 /
+		SDL_GetPerformanceFrequency() / FRAMES;
+
+}
+
+void free_resources() {
+
+	glDeleteTextures(1, &texture_flat);
+	glDeleteTextures(1, &texture_mipmapped);
+	glDeleteProgram(program);
+	glDeleteBuffers(1, &vbo_quad);
+	dash_program_reflection_free(&program_vars);
+	dash_shader_cache_clear();
+
+}
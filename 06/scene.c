@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <GL/glew.h>
+#include "SDL.h"
+#include "lib/dashgl.h"
+
+// Vertex-heavy scene: a dense grid drawn many times into a tiny viewport
+// with rasterization discarded, so the frame time is dominated by the vertex
+// shader. The same scene is drawn with the three matrix shader and the
+// premultiplied mvp shader.
+
+#define WIDTH 64
+#define HEIGHT 64
+#define GRID 256
+#define OBJECTS 16
+#define FRAMES 20
+
+GLuint program_chain, program_mvp;
+GLuint vbo_grid;
+GLint vertex_count;
+camera view_camera;
+mat4 model[OBJECTS], mvp[OBJECTS];
+
+bool init_resources();
+double draw_chain();
+double draw_mvp();
+void bind_grid(GLuint program);
+void free_resources();
+
+int main(int argc, char *argv[]) {
+
+	double chain_ms, mvp_ms, verts;
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window *window = SDL_CreateWindow(
+		"Vertex Benchmark",
+		SDL_WINDOWPOS_CENTERED,
+		SDL_WINDOWPOS_CENTERED,
+		WIDTH,
+		HEIGHT,
+		SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL
+	);
+
+	if(window == NULL) {
+		fprintf(stderr, "Error can't create window %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+
+	if(SDL_GL_CreateContext(window) == NULL) {
+		fprintf(stderr, "Error can't create context %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	GLenum glew_status = glewInit();
+	if(glew_status != GLEW_OK) {
+		fprintf(stderr, "Error glewInit: %s\n", glewGetErrorString(glew_status));
+		exit(1);
+	}
+
+	if(!init_resources()) {
+		exit(1);
+	}
+
+	// Skip rasterization where available so only vertex work is timed
+	if(GLEW_VERSION_3_0) {
+		glEnable(GL_RASTERIZER_DISCARD);
+	}
+
+	// First pass of each warms up shader compilation in the driver
+	draw_chain();
+	draw_mvp();
+
+	chain_ms = draw_chain();
+	mvp_ms = draw_mvp();
+	verts = (double)vertex_count * OBJECTS / 1e6;
+
+	printf("renderer: %s\n", glGetString(GL_RENDERER));
+	printf("vertices per frame   %8.2f M\n", verts);
+	printf("perspective*lookat*m %8.2f ms/frame %8.2f Mverts/s\n", chain_ms, verts / chain_ms * 1e3);
+	printf("premultiplied mvp    %8.2f ms/frame %8.2f Mverts/s\n", mvp_ms, verts / mvp_ms * 1e3);
+	printf("speedup              %8.2fx\n", chain_ms / mvp_ms);
+
+	free_resources();
+	return 0;
+
+}
+
+bool init_resources() {
+
+	int x, y, i, n;
+	float *vertices;
+	float step = 2.0f / GRID;
+	// Two triangles per cell, xyz plus the texcoord the shaders expect
+	static const int corner[6][2] = {
+		{ 0, 0 }, { 1, 0 }, { 1, 1 },
+		{ 1, 1 }, { 0, 1 }, { 0, 0 }
+	};
+
+	vertex_count = GRID * GRID * 6;
+	vertices = (float*)malloc(sizeof(float) * 5 * vertex_count);
+	if(vertices == NULL) {
+		fprintf(stderr, "Could not allocate %d vertices\n", vertex_count);
+		return false;
+	}
+
+	n = 0;
+	for(y = 0; y < GRID; y++) {
+		for(x = 0; x < GRID; x++) {
+			for(i = 0; i < 6; i++) {
+				vertices[n++] = -1.0f + (x + corner[i][0]) * step;
+				vertices[n++] = -1.0f + (y + corner[i][1]) * step;
+				vertices[n++] = 0.0f;
+				vertices[n++] = (float)(x + corner[i][0]) / GRID;
+				vertices[n++] = (float)(y + corner[i][1]) / GRID;
+			}
+		}
+	}
+
+	glGenBuffers(1, &vbo_grid);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_grid);
+	glBufferData(
+		GL_ARRAY_BUFFER,
+		sizeof(float) * 5 * vertex_count,
+		vertices,
+		GL_STATIC_DRAW
+	);
+	free(vertices);
+
+	// Queue both programs before waiting so the driver can build them together
+	// and share one fragment shader between them
+	const char *chain_defines[] = { "MATRIX_CHAIN", NULL };
+	program_request chain_request, mvp_request;
+	dash_program_submit("sdr/vertex.glsl", "sdr/fragment.glsl", chain_defines, &chain_request);
+	dash_program_submit("sdr/vertex.glsl", "sdr/fragment.glsl", NULL, &mvp_request);
+	program_chain = dash_program_wait(&chain_request);
+	program_mvp = dash_program_wait(&mvp_request);
+	if(program_chain == 0 || program_mvp == 0) {
+		fprintf(stderr, "Program creation error\n");
+		return false;
+	}
+
+	vec3 eye = { 0.0f, 2.0f, 0.0f };
+	vec3 target = { 0.0f, 0.0f, -4.0f };
+	vec3 axis = { 0.0f, 1.0f, 0.0f };
+
+	mat4_perspective(45.0f, 1.0f*WIDTH/HEIGHT, 0.1f, 10.0f, view_camera.projection);
+	mat4_look_at(eye, target, axis, view_camera.view);
+	camera_update(&view_camera);
+
+	for(i = 0; i < OBJECTS; i++) {
+		vec3 t = { 0.0f, 0.0f, -4.0f };
+		vec3 r = { 0.1f * i, 0.2f * i, 0.3f * i };
+		mat4_compose(t, r, NULL, model[i]);
+	}
+
+	return true;
+
+}
+
+void bind_grid(GLuint program) {
+
+	GLint coord3d = glGetAttribLocation(program, "coord3d");
+	GLint texcoord = glGetAttribLocation(program, "texcoord");
+
+	glUseProgram(program);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_grid);
+	glEnableVertexAttribArray(coord3d);
+	glVertexAttribPointer(coord3d, 3, GL_FLOAT, GL_FALSE, sizeof(float)*5, 0);
+
+	if(texcoord != -1) {
+		glEnableVertexAttribArray(texcoord);
+		glVertexAttribPointer(
+			texcoord,
+			2,
+			GL_FLOAT,
+			GL_FALSE,
+			sizeof(float)*5,
+			(void*)(sizeof(float) * 3)
+		);
+	}
+
+}
+
+// Original path: three matrices uploaded, combined per vertex on the GPU
+double draw_chain() {
+
+	int f, i;
+	Uint64 start;
+
+	bind_grid(program_chain);
+	GLint uniform_perspective = glGetUniformLocation(program_chain, "perspective");
+	GLint uniform_lookat = glGetUniformLocation(program_chain, "lookat");
+	GLint uniform_mvp = glGetUniformLocation(program_chain, "mvp");
+
+	glFinish();
+	start = SDL_GetPerformanceCounter();
+
+	for(f = 0; f < FRAMES; f++) {
+		glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+		glUniformMatrix4fv(uniform_perspective, 1, GL_FALSE, view_camera.projection);
+		glUniformMatrix4fv(uniform_lookat, 1, GL_FALSE, view_camera.view);
+		for(i = 0; i < OBJECTS; i++) {
+			glUniformMatrix4fv(uniform_mvp, 1, GL_FALSE, model[i]);
+			glDrawArrays(GL_TRIANGLES, 0, vertex_count);
+		}
+		glFinish();
+	}
+
+	return (SDL_GetPerformanceCounter() - start) * 1e3 /
+		SDL_GetPerformanceFrequency() / FRAMES;
+
+}
+
+// Premultiplied path: view-projection once per frame, mvp once per object
+double draw_mvp() {
+
+	int f, i;
+	Uint64 start;
+
+	bind_grid(program_mvp);
+	GLint uniform_mvp = glGetUniformLocation(program_mvp, "mvp");
+
+	glFinish();
+	start = SDL_GetPerformanceCounter();
+
+	for(f = 0; f < FRAMES; f++) {
+		glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+		camera_update(&view_camera);
+		camera_mvp_batch(&view_camera, model, mvp, OBJECTS);
+		for(i = 0; i < OBJECTS; i++) {
+			glUniformMatrix4fv(uniform_mvp, 1, GL_FALSE, mvp[i]);
+			glDrawArrays(GL_TRIANGLES, 0, vertex_count);
+		}
+		glFinish();
+	}
+
+	return (SDL_GetPerformanceCounter() - start) * 1e3 /
+		SDL_GetPerformanceFrequency() / FRAMES;
+
+}
+
+void free_resources() {
+
+	glDeleteProgram(program_chain);
+	glDeleteProgram(program_mvp);
+	dash_shader_cache_clear();
+	glDeleteBuffers(1, &vbo_grid);
+
+}
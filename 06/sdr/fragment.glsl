@@ -1,9 +1,9 @@
-varying vec2 f_texcoord;
+#include "varying.glsl"
+
 uniform sampler2D mytexture;
 
 void main(void) {
-	
-	vec2 flipped_texcoord = vec2(f_texcoord.x, 1.0 - f_texcoord.y);
-	gl_FragColor = texture2D(mytexture, flipped_texcoord);
+
+	gl_FragColor = texture2D(mytexture, f_texcoord);
 
 }
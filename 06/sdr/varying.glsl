@@ -0,0 +1 @@
+varying vec2 f_texcoord;
@@ -1,11 +1,20 @@
+#include "varying.glsl"
+
 attribute vec3 coord3d;
 attribute vec2 texcoord;
-uniform mat4 perspective, lookat, mvp;
-varying vec2 f_texcoord;
+uniform mat4 mvp;
+
+#ifdef MATRIX_CHAIN
+uniform mat4 perspective, lookat;
+#endif
 
 void main(void) {
 
+#ifdef MATRIX_CHAIN
 	gl_Position = perspective * lookat * mvp * vec4(coord3d, 1.0);
+#else
+	gl_Position = mvp * vec4(coord3d, 1.0);
+#endif
 	f_texcoord = texcoord;
 
 }